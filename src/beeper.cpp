@@ -1,26 +1,42 @@
 #include <beeper.h>
+
+#include <algorithm>
 #include <cmath>
 #include <stdexcept>
 
 
 Beeper::Beeper(
     float freq,
-    float duration,
+    int buffer_samples,
     float attack,
     float sustain,
-    float decay)
-    : m_freq(freq)
-    , m_duration_left(duration)
-    , m_attack(attack)
+    float release)
+    : m_attack(attack)
     , m_sustain(sustain)
-    , m_decay(decay)
+    , m_release(release)
+    , m_target_fill(0)
+    , m_primed(false)
+    , m_sample_debt(0.)
+    , m_phase(0)
+    , m_step(0)
+    , m_pattern{}
+    , m_pattern_step(0)
+    , m_pattern_set(false)
+    , m_on(false)
+    , m_time(0.f)
+    , m_amplitude(0.f)
+    , m_amplitude_from(0.f)
 {
+    for (size_t i = 0; i < m_wavetable.size(); i++) {
+        m_wavetable[i] = std::sin(2. * M_PI * (double)i / (double)(1 << wavetable_bits));
+    }
+
     SDL_AudioSpec specs_desired;
     SDL_zero(specs_desired);
 
     specs_desired.freq     = 44100;
     specs_desired.format   = AUDIO_S16SYS;
-    specs_desired.samples  = 2048;
+    specs_desired.samples  = buffer_samples;
     specs_desired.channels = 1;
     specs_desired.callback = Beeper::audio_cb;
     specs_desired.userdata = this;
@@ -29,7 +45,7 @@ Beeper::Beeper(
         NULL, 0,
         &specs_desired,
         &m_specs,
-        0
+        SDL_AUDIO_ALLOW_SAMPLES_CHANGE
     );
 
     if (!m_audio_dev) {
@@ -39,6 +55,18 @@ Beeper::Beeper(
     if (specs_desired.format != m_specs.format) {
         throw std::runtime_error(SDL_GetError());
     }
+
+    // A device buffer plus the samples of a frame, so the callback still
+    // finds a full buffer right before the next frame is rendered
+    m_target_fill = std::min(
+        (size_t)m_specs.samples + m_specs.freq / 60,
+        m_ring.capacity() / 2);
+
+    // Phase increment of a whole 32 bit turn per period
+    m_step = (uint32_t)(uint64_t)(freq / m_specs.freq * 4294967296.);
+
+    // The callback outputs silence until the first frames are rendered
+    setPaused(0);
 }
 
 
@@ -54,77 +82,161 @@ void Beeper::setPaused(int is_paused)
 }
 
 
-void Beeper::setDurationLeft(float duration)
+void Beeper::renderFrame(double duration, double on_begin, double on_end)
 {
-    m_duration_left = duration;
+    // Nudge the rate by up to 0.5% towards the target fill, too little to
+    // change the pitch audibly
+    const double max_adjust = 0.005;
+    const double fill = (double)std::min(m_ring.size(), 2 * m_target_fill);
+    const double ratio = 1. + max_adjust * ((double)m_target_fill - fill) / (double)m_target_fill;
+
+    m_sample_debt += duration * m_specs.freq * ratio;
 
-    if (m_duration_left > 0.f) {
-        setPaused(0);
+    const int n = (int)m_sample_debt;
+    m_sample_debt -= n;
+
+    if (n == 0) {
+        return;
     }
+
+    m_frame.resize(n);
+
+    // The sound switches at the sample closest to its emulated time
+    const int on_start = std::min(n, std::max(0, (int)std::lround(on_begin * n)));
+    const int on_stop  = std::min(n, std::max(on_start, (int)std::lround(on_end * n)));
+
+    render(m_frame.data(),            on_start,            false);
+    render(m_frame.data() + on_start, on_stop - on_start,  true);
+    render(m_frame.data() + on_stop,  n - on_stop,         false);
+
+    // A full ring means the device is paused or stalled, the excess is lost
+    m_ring.write(m_frame.data(), n);
 }
 
 
-float Beeper::minDuration() const
+void Beeper::setPattern(const std::array<uint8_t, 16>& pattern, float rate)
 {
-    return m_attack + m_sustain + m_decay;
+    m_pattern       = pattern;
+    m_pattern_set   = true;
+
+    // 128 samples per 32 bit turn of the phase, the top 7 bits index the
+    // pattern
+    m_pattern_step  = (uint32_t)(rate / (double)m_specs.freq * (double)(1u << 25));
 }
 
 
-void Beeper::audio_cb(void * userdata, Uint8* stream, int len)
+float Beeper::envelope(bool on, float t) const
 {
-    Beeper* b = (Beeper*)userdata;
-
     const float max_amplitude     = 30000.f;
     const float sustain_amplitude = 10000.f;
-    const float sample_duration = 1.f / (float)b->m_specs.freq;
 
-    SDL_LockAudioDevice(b->m_audio_dev);
+    if (!on) {
+        // Release from wherever the note was
+        return t < m_release ? m_amplitude_from * (1.f - t / m_release) : 0.f;
+    } else if (t < m_attack) {
+        // Start of the note
+        return m_amplitude_from + t / m_attack * (max_amplitude - m_amplitude_from);
+    } else if (t - m_attack < m_sustain) {
+        // Sustain
+        const float a = (t - m_attack) / m_sustain;
+        return max_amplitude + a * (sustain_amplitude - max_amplitude);
+    }
 
-    Sint16* samples = (Sint16*)stream;
+    // Permanent mode
+    return sustain_amplitude;
+}
 
-    for (int i = 0; i < len / 2; i++) {
-        if (b->m_duration_left > 0.f) {
-            const float t = (float)(i + b->m_samples_gen) / (float)(b->m_specs.freq);
 
-            float amplitude = 0.f;
+void Beeper::render(Sint16* out, int count, bool on)
+{
+    // Envelope evaluated every block samples, about 1.5 ms
+    const int block = 64;
+    const float sample_duration = 1.f / (float)m_specs.freq;
+
+    if (on != m_on) {
+        m_on = on;
+        m_time = 0.f;
+        m_amplitude_from = m_amplitude;
+    }
 
-            if (b->m_duration_left <= b->m_decay) {
-                // End of the note
-                const float a = b->m_duration_left / b->m_decay;
-                amplitude = a * sustain_amplitude;
-            }
-            else if (b->m_duration_played < b->m_attack) {
-                // Start of the note
-                const float a = b->m_duration_played / b->m_attack;
-                amplitude = a * max_amplitude;
-            }
-            else if (b->m_duration_played - b->m_attack < b->m_sustain) {
-                // Sustain
-                const float a = (b->m_duration_played - b->m_attack) / (b->m_sustain);
-                amplitude = max_amplitude + a * (sustain_amplitude - max_amplitude);
-            }
-            else {
-                // Permanent mode
-                amplitude = sustain_amplitude;
-            }
+    int i = 0;
+
+    while (i < count) {
+        const int n = std::min(block, count - i);
+        const float duration = n * sample_duration;
 
-            samples[i] = amplitude * std::sin(2. * M_PI * t * b->m_freq);
+        const float a_start = m_amplitude;
+        const float a_end   = envelope(m_on, m_time + duration);
+        const float a_step  = (a_end - a_start) / n;
 
-            b->m_duration_left -= sample_duration;
-            b->m_duration_played += sample_duration;
+        m_time += duration;
+        m_amplitude = a_end;
+
+        if (a_start == 0.f && a_end == 0.f) {
+            std::fill(out + i, out + i + n, (Sint16)0);
+            i += n;
+            continue;
+        }
+
+        float amplitude = a_start;
+
+        if (m_pattern_set) {
+            for (int j = 0; j < n; j++) {
+                // 7 upper bits of the phase index the pattern, most
+                // significant bit first
+                const uint32_t index = m_phase >> 25;
+                const bool set = (m_pattern[index >> 3] >> (7 - (index & 7))) & 1;
+
+                out[i + j] = (Sint16)(set ? amplitude : -amplitude);
+
+                m_phase   += m_pattern_step;
+                amplitude += a_step;
+            }
         } else {
-            samples[i] = 0;
-            b->m_duration_played = 0;
-            b->setPaused(1);
+            const int frac_bits = 32 - wavetable_bits;
+            const float frac_scale = 1.f / (float)(1u << frac_bits);
+
+            for (int j = 0; j < n; j++) {
+                // Linear interpolation between two entries of the table
+                const uint32_t index = m_phase >> frac_bits;
+                const float frac = (float)(m_phase & ((1u << frac_bits) - 1)) * frac_scale;
+                const float s0 = m_wavetable[index];
+                const float s1 = m_wavetable[index + 1];
+
+                out[i + j] = (Sint16)(amplitude * (s0 + frac * (s1 - s0)));
+
+                m_phase   += m_step;
+                amplitude += a_step;
+            }
         }
 
-        // Debug
-        // std::cout << i + b->m_samples_gen << " " << samples[i] << std::endl;
+        i += n;
+    }
+}
+
+
+void Beeper::audio_cb(void * userdata, Uint8* stream, int len)
+{
+    Beeper* b = (Beeper*)userdata;
+
+    Sint16* samples = (Sint16*)stream;
+    const size_t n_samples = len / 2;
+
+    // After running out, wait for the ring to refill to its target so a
+    // single late frame does not cause a train of dropouts
+    if (!b->m_primed && b->m_ring.size() >= b->m_target_fill) {
+        b->m_primed = true;
     }
 
-    b->m_samples_gen = (b->m_samples_gen + b->m_specs.samples) % b->m_specs.freq;
-    // Replace by this if you use the debug printf
-    // b->m_samples_gen = (b->m_samples_gen + b->m_specs.samples);
+    size_t n = 0;
+
+    if (b->m_primed) {
+        n = b->m_ring.read(samples, n_samples);
+
+        if (n < n_samples) {
+            b->m_primed = false;
+        }
+    }
 
-    SDL_UnlockAudioDevice(b->m_audio_dev);
-}
\ No newline at end of file
+    std::fill(samples + n, samples + n_samples, (Sint16)0);
+}
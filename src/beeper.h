@@ -2,41 +2,96 @@
 
 #include <SDL.h>
 
+#include <sample_ring.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Streams the sound of the emulated computer, the beep of the sound timer or
+// an XO-CHIP pattern, to its own audio device.
+//
+// The emulation thread renders the samples of each emulated frame with a
+// phase accumulator over a sine wavetable, the envelope being evaluated once
+// per block of samples and ramped linearly within the block. The audio
+// callback only copies them out of a lock-free ring. The number of samples
+// rendered per frame is adjusted by a fraction of a percent to keep the ring
+// around its target fill, so the emulation and audio clocks never drift
+// apart.
 class Beeper
 {
 public:
+    // buffer_samples is the size of the device buffer, latency is about
+    // twice that plus a frame of samples
     Beeper(
-        float freq     = 440.f,
-        float duration = 1.f,
-        float attack   = 1.f/60.f,
-        float sustain  = 1.f/60.f,
-        float decay    = 1.f/60.f
+        float freq         = 440.f,
+        int buffer_samples = 512,
+        float attack       = 1.f/60.f,
+        float sustain      = 1.f/60.f,
+        float release      = 1.f/60.f
     );
 
     virtual ~Beeper();
 
     void setPaused(int is_paused);
 
-    void setDurationLeft(float duration);
+    // Emulation thread side. Render a frame lasting duration seconds, the
+    // sound being on between the fractions on_begin and on_end of the frame.
+    void renderFrame(double duration, double on_begin, double on_end);
 
-    float minDuration() const;
+    // Play an XO-CHIP pattern of 128 samples of 1 bit in a loop instead of
+    // the sine, rate is given in samples per second
+    void setPattern(const std::array<uint8_t, 16>& pattern, float rate);
 
-    float durationLeft() const { return m_duration_left; }
+    int sampleRate() const { return m_specs.freq; }
 
 protected:
     static void audio_cb(void * userdata, Uint8* stream, int len);
 
-protected:
-    float m_freq;
+    // Render count samples with the sound on or off
+    void render(Sint16* out, int count, bool on);
+
+    // Amplitude t seconds after the sound was switched on or off
+    float envelope(bool on, float t) const;
 
-    float m_duration_played;
-    float m_duration_left;
+    static const int wavetable_bits = 10;
 
+protected:
     float m_attack;
     float m_sustain;
-    float m_decay;
+    float m_release;
 
     SDL_AudioSpec m_specs;
     SDL_AudioDeviceID m_audio_dev;
-    int m_samples_gen;
-};
\ No newline at end of file
+
+    // Samples the ring holds on average, the callback waits for that much
+    // before starting to play again after running out
+    size_t m_target_fill;
+
+    // Emulation thread to audio callback, about 370 ms at 44.1 kHz
+    SampleRing<Sint16, 16384> m_ring;
+
+    // Only touched by the audio callback
+    bool m_primed;
+
+    // Only touched by the emulation thread
+    std::vector<Sint16> m_frame;
+    double m_sample_debt;
+
+    // One period of a sine, the extra entry avoids wrapping when
+    // interpolating the last one
+    std::array<float, (1 << wavetable_bits) + 1> m_wavetable;
+
+    uint32_t m_phase;
+    uint32_t m_step;
+
+    std::array<uint8_t, 16> m_pattern;
+    uint32_t m_pattern_step;
+    bool m_pattern_set;
+
+    // Envelope state since the last switch on or off
+    bool m_on;
+    float m_time;
+    float m_amplitude;
+    float m_amplitude_from;
+};
@@ -0,0 +1,280 @@
+#include <capture.h>
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+
+VideoCapture::VideoCapture(const std::string& path, Format format, const Palette& palette)
+    : m_file(nullptr)
+    , m_format(format)
+    , m_overflowing(false)
+    , m_overflow_published(0)
+    , m_overflow_taken(0)
+    , m_sequence(0)
+    , m_changes_skipped(0)
+    , m_quit(false)
+    , m_image(width * height, 0)
+    , m_image_frame(0)
+    , m_has_image(false)
+    , m_next_sequence(0)
+    , m_frames_written(0)
+    , m_end_frame(0)
+{
+    m_file = (path == "-") ? stdout : std::fopen(path.c_str(), "wb");
+
+    if (!m_file) {
+        throw std::runtime_error("Could not open the capture file " + path);
+    }
+
+    // Rec. 601 luma of the 0xRRGGBB colours
+    for (size_t i = 0; i < m_levels.size(); i++) {
+        const uint32_t rgb = palette[i];
+        m_levels[i] = (uint8_t)((299 * ((rgb >> 16) & 0xFF) + 587 * ((rgb >> 8) & 0xFF) + 114 * (rgb & 0xFF) + 500) / 1000);
+    }
+
+    for (int byte = 0; byte < 256; byte++) {
+        uint16_t doubled = 0;
+
+        for (int b = 0; b < 8; b++) {
+            if (byte & (1 << b)) {
+                doubled |= 3 << (2 * b);
+            }
+        }
+
+        m_double_bits[byte] = doubled;
+    }
+
+    if (m_format == FORMAT_Y4M) {
+        std::fprintf(m_file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n", width, height);
+    }
+
+    m_thread = std::thread(&VideoCapture::run, this);
+}
+
+
+VideoCapture::~VideoCapture()
+{
+    if (m_thread.joinable()) {
+        finish(0);
+    }
+
+    if (m_file && m_file != stdout) {
+        std::fclose(m_file);
+    }
+}
+
+
+bool VideoCapture::parseFormat(const std::string& name, Format& format)
+{
+    if (name == "y4m") {
+        format = FORMAT_Y4M;
+    } else if (name == "monob") {
+        format = FORMAT_MONOB;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+VideoCapture::Format VideoCapture::defaultFormat(const std::string& path)
+{
+    const std::string y4m_extension = ".y4m";
+
+    if (path == "-"
+     || (path.size() >= y4m_extension.size()
+      && path.compare(path.size() - y4m_extension.size(), y4m_extension.size(), y4m_extension) == 0)) {
+        return FORMAT_Y4M;
+    }
+
+    return FORMAT_MONOB;
+}
+
+
+void VideoCapture::push(uint64_t frame, const uint8_t* screen, const uint8_t* second_plane, int screen_w, int screen_h)
+{
+    Change change;
+
+    change.sequence   = m_sequence++;
+    change.frame      = frame;
+    change.two_planes = (second_plane != nullptr);
+    change.hires      = (screen_w == width);
+
+    const size_t size = screen_w * screen_h / 8;
+
+    std::memcpy(change.planes[0].data(), screen, size);
+
+    if (second_plane) {
+        std::memcpy(change.planes[1].data(), second_plane, size);
+    }
+
+    // Back to the queue once the writer caught up with the slot, the later
+    // changes come after it
+    if (m_overflowing && m_overflow_taken.load(std::memory_order_acquire) == m_overflow_published) {
+        m_overflowing = false;
+    }
+
+    if (!m_overflowing && m_changes.push(change)) {
+        m_wake_cond.notify_one();
+        return;
+    }
+
+    m_overflowing = true;
+
+    // The change still in the slot is replaced by this one
+    if (m_overflow_taken.load(std::memory_order_acquire) != m_overflow_published) {
+        m_changes_skipped++;
+    }
+
+    m_overflow.back() = change;
+    m_overflow.publish();
+    m_overflow_published = change.sequence + 1;
+
+    m_wake_cond.notify_one();
+}
+
+
+void VideoCapture::finish(uint64_t frame)
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    m_end_frame = frame;
+    m_quit.store(true);
+
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_wake_cond.notify_one();
+    }
+
+    m_thread.join();
+}
+
+
+void VideoCapture::run()
+{
+    Change change;
+
+    while (true) {
+        // Checked before draining so the last changes are written
+        const bool quit = m_quit.load();
+
+        while (m_changes.pop(change)) {
+            apply(change);
+        }
+
+        // Newer than anything queued before it
+        if (m_overflow.update()) {
+            const Change& latest = m_overflow.front();
+
+            apply(latest);
+            m_overflow_taken.store(latest.sequence + 1, std::memory_order_release);
+        }
+
+        if (quit) {
+            break;
+        }
+
+        // A notification can be missed as the producer does not lock, the
+        // timeout bounds the delay
+        std::unique_lock<std::mutex> lock(m_wake_mutex);
+        m_wake_cond.wait_for(lock, std::chrono::milliseconds(10));
+    }
+
+    if (m_has_image) {
+        write(m_end_frame > m_image_frame ? m_end_frame - m_image_frame : 1);
+    }
+
+    std::fflush(m_file);
+}
+
+
+void VideoCapture::apply(const Change& change)
+{
+    // Queued before the slot was taken but pushed after it
+    if (change.sequence < m_next_sequence) {
+        return;
+    }
+
+    // The previous image lasted until this change
+    if (m_has_image) {
+        write(change.frame - m_image_frame);
+    }
+
+    render(change);
+    m_image_frame = change.frame;
+    m_has_image = true;
+    m_next_sequence = change.sequence + 1;
+}
+
+
+void VideoCapture::render(const Change& change)
+{
+    const int src_w = change.hires ? width : width / 2;
+    const int row_bytes = src_w / 8;
+
+    if (m_format == FORMAT_MONOB) {
+        // A pixel is white when set in any plane
+        for (int y = 0; y < height; y++) {
+            const int src_y = change.hires ? y : y / 2;
+            uint8_t* dst = &m_image[y * width / 8];
+
+            for (int i = 0; i < row_bytes; i++) {
+                uint8_t byte = change.planes[0][src_y * row_bytes + i];
+
+                if (change.two_planes) {
+                    byte |= change.planes[1][src_y * row_bytes + i];
+                }
+
+                if (change.hires) {
+                    dst[i] = byte;
+                } else {
+                    dst[2 * i]     = (uint8_t)(m_double_bits[byte] >> 8);
+                    dst[2 * i + 1] = (uint8_t)m_double_bits[byte];
+                }
+            }
+        }
+
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const int src_y = change.hires ? y : y / 2;
+        const uint8_t* first  = &change.planes[0][src_y * row_bytes];
+        const uint8_t* second = &change.planes[1][src_y * row_bytes];
+        uint8_t* dst = &m_image[y * width];
+
+        for (int x = 0; x < width; x++) {
+            const int src_x = change.hires ? x : x / 2;
+            const int bit = 7 - (src_x & 7);
+
+            int index = (first[src_x >> 3] >> bit) & 1;
+
+            if (change.two_planes) {
+                index |= ((second[src_x >> 3] >> bit) & 1) << 1;
+            }
+
+            dst[x] = m_levels[index];
+        }
+    }
+}
+
+
+void VideoCapture::write(uint64_t count)
+{
+    // A raw frame is packed, 1 KiB instead of 8 KiB
+    const size_t size = (m_format == FORMAT_MONOB) ? width * height / 8 : width * height;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (m_format == FORMAT_Y4M) {
+            std::fputs("FRAME\n", m_file);
+        }
+
+        std::fwrite(m_image.data(), 1, size, m_file);
+    }
+
+    m_frames_written.fetch_add(count);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <pixels.h>
+#include <spsc_queue.h>
+#include <triple_buffer.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes the emulated screen as a 60 frames per second video, at emulated
+// frame times whatever the emulation speed.
+//
+// Only screen changes are handed over, through a lock-free queue, to a writer
+// thread which repeats each image until the next change. The emulation never
+// waits for the disk: when the queue is full the changes are coalesced in a
+// single slot until the writer catches up, the intermediate screens are
+// skipped and counted but the latest one always reaches the video.
+//
+// The video is always 128x64, the low resolution being doubled, either as a
+// grayscale YUV4MPEG2 stream or as raw 1 bit per pixel frames of 1 KiB that
+// ffmpeg reads with:
+//
+//   ffmpeg -f rawvideo -pix_fmt monob -s 128x64 -r 60 -i <file> ...
+class VideoCapture
+{
+public:
+    enum Format {
+        FORMAT_Y4M,
+        FORMAT_MONOB
+    };
+
+    // "-" writes to the standard output. The palette gives the gray levels
+    // of the Y4M stream. Throws a std::runtime_error if the file cannot be
+    // opened.
+    VideoCapture(const std::string& path, Format format, const Palette& palette);
+
+    virtual ~VideoCapture();
+
+    // Emulation thread side. From the given frame on, the screen shows these
+    // planes of width / 8 bytes per row. The second plane is null when
+    // empty.
+    void push(uint64_t frame, const uint8_t* screen, const uint8_t* second_plane, int screen_w, int screen_h);
+
+    // Write the last image up to the given frame and wait for the writer
+    void finish(uint64_t frame);
+
+    Format format() const { return m_format; }
+
+    // Format from its name, y4m or monob. Returns false if unknown.
+    static bool parseFormat(const std::string& name, Format& format);
+
+    // Format when none is given: raw frames, unless the path ends with .y4m
+    // or is the standard output, where a pipe to ffmpeg needs the header
+    static Format defaultFormat(const std::string& path);
+
+    uint64_t framesWritten() const { return m_frames_written.load(); }
+    uint64_t changesSkipped() const { return m_changes_skipped; }
+
+    static const int width  = 128;
+    static const int height = 64;
+
+protected:
+    struct Change {
+        // Order of the push, the slot can overtake the queue
+        uint64_t sequence;
+        uint64_t frame;
+        std::array<std::array<uint8_t, 1024>, 2> planes;
+        bool two_planes;
+        bool hires;
+    };
+
+    void run();
+
+    // Write the previous image up to this change, unless it is older
+    void apply(const Change& change);
+
+    // Convert a change to an output image
+    void render(const Change& change);
+
+    // Write the current image count times
+    void write(uint64_t count);
+
+protected:
+    std::FILE* m_file;
+    Format m_format;
+
+    // Gray level for no plane, the first, the second and both
+    std::array<uint8_t, 4> m_levels;
+
+    // Each byte of a low resolution row with its bits doubled
+    std::array<uint16_t, 256> m_double_bits;
+
+    SpscQueue<Change, 128> m_changes;
+
+    // Newest change while the queue is full. The producer goes back to the
+    // queue once the writer took it.
+    TripleBuffer<Change> m_overflow;
+    bool m_overflowing;
+    uint64_t m_overflow_published;
+    std::atomic<uint64_t> m_overflow_taken;
+
+    uint64_t m_sequence;
+    uint64_t m_changes_skipped;
+
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake_cond;
+
+    // Only touched by the writer thread
+    std::vector<uint8_t> m_image;
+    uint64_t m_image_frame;
+    bool m_has_image;
+    uint64_t m_next_sequence;
+    std::atomic<uint64_t> m_frames_written;
+
+    // Written before finish() wakes the writer for the last time
+    uint64_t m_end_frame;
+};
@@ -5,18 +5,48 @@
 #include <cstdlib>
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COMPUTER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPUTER_SSE2
+#endif
 
 Computer::Computer(
-    const std::vector<uint8_t>& program)
+    const std::vector<uint8_t>& program,
+    uint32_t cycles_per_frame,
+    uint64_t seed,
+    const Quirks& quirks)
     : m_wait_for_key_press(false)
-    , m_delay_timer(0)
-    , m_sound_timer(0)
+    , m_key_pressed_while_waiting(false)
+    , m_last_key_pressed(0)
+    , m_cycle(0)
+    , m_cycles_per_frame(cycles_per_frame)
+    , m_delay_expiry(0)
+    , m_sound_expiry(0)
+    , m_sound_start_cycle(UINT64_MAX)
+    , m_quirks(quirks)
     , m_I_register(0)
+    , m_long_addressing(program.size() > 0x1000 - 0x200)
     , m_program_counter(0x200)
-    , m_screen(screen_width / 8 * screen_height)
+    , m_screen(2 * plane_words, 0)
+    , m_hires(false)
+    , m_planes(0x1)
+    , m_screen_generation(0)
+    , m_dirty_rows(~(uint64_t)0)
+    , m_seed(seed)
+    , m_rng(seed)
 {
-    // Fist ensure the program can fit in ram
-    const uint16_t ram_pgm_available = 0xE8F - 0x200 + 1;
+    // Start from a known state so a run only depends on its seed
+    m_registers.fill(0);
+    m_memory.fill(0);
+
+    // Fist ensure the program can fit in ram, XO-CHIP programs can use the
+    // whole 64 KiB
+    const size_t ram_pgm_available = m_memory.size() - 0x200;
 
     // Copy the program to ram
     if (program.size() > ram_pgm_available) {
@@ -43,39 +73,232 @@ Computer::Computer(
     std::memcpy(&m_memory[0xE * 5], char_E, 5);
     std::memcpy(&m_memory[0xF * 5], char_F, 5);
 
+    std::memcpy(&m_memory[big_font_address], big_font, sizeof(big_font));
+
+    m_rpl_flags.fill(0);
+
+    m_audio_pattern.fill(0);
+    m_audio_pattern_set = false;
+    m_audio_pitch = 64;
+    m_audio_generation = 0;
+
     for (int i = 0; i < m_keypad.size(); i++) {
         m_keypad[i] = false;
+        m_key_reads[i] = 0;
+        m_key_read_cycle[i] = UINT64_MAX;
+        m_key_latched[i] = false;
+        m_key_release_cycle[i] = 0;
     }
 }
 
 
+std::string Quirks::name() const
+{
+    std::string names;
+
+    if (shift_vx) {
+        names += "shift";
+    }
+
+    if (load_store_increment) {
+        names += names.empty() ? "load-store" : ",load-store";
+    }
+
+    return names.empty() ? "none" : names;
+}
+
+
+bool Quirks::parse(const std::string& names, Quirks& quirks)
+{
+    Quirks parsed;
+    parsed.shift_vx = false;
+    parsed.load_store_increment = false;
+
+    size_t start = 0;
+
+    while (start <= names.size()) {
+        const size_t end = std::min(names.find(',', start), names.size());
+        const std::string name = names.substr(start, end - start);
+
+        if (name == "shift") {
+            parsed.shift_vx = true;
+        } else if (name == "load-store") {
+            parsed.load_store_increment = true;
+        } else if (name != "none") {
+            return false;
+        }
+
+        start = end + 1;
+    }
+
+    quirks = parsed;
+    return true;
+}
+
+
+void Computer::screenBits(uint8_t* out, uint8_t plane) const
+{
+    const uint64_t* rows = &m_screen[plane * plane_words];
+
+    for (uint8_t y = 0; y < height(); y++) {
+        for (uint8_t i = 0; i < width() / 8; i++) {
+            *out++ = (uint8_t)(rows[2 * y + i / 8] >> (56 - 8 * (i % 8)));
+        }
+    }
+}
+
+
+uint8_t Computer::planeCount() const
+{
+    uint64_t second = 0;
+
+    for (size_t i = plane_words; i < 2 * plane_words; i++) {
+        second |= m_screen[i];
+    }
+
+    return second ? 2 : 1;
+}
+
+
+float Computer::audioPatternRate() const
+{
+    return 4000.f * std::pow(2.f, ((float)m_audio_pitch - 64.f) / 48.f);
+}
+
+
 void Computer::keyPress(uint8_t key)
 {
     m_last_key_pressed = key;
     m_keypad[key] = true;
+    m_key_latched[key] = true;
+    m_key_read_cycle[key] = UINT64_MAX;
+
+    if (m_wait_for_key_press) {
+        m_key_pressed_while_waiting = true;
+    }
 }
 
 
 void Computer::keyRelease(uint8_t key) {
     m_keypad[key] = false;
+    m_key_release_cycle[key] = m_cycle;
+    m_key_read_cycle[key] = UINT64_MAX;
+}
+
+
+uint16_t Computer::keysDown() const
+{
+    uint16_t keys = 0;
+
+    for (size_t i = 0; i < m_keypad.size(); i++) {
+        keys |= (uint16_t)(m_keypad[i] ? 1 : 0) << i;
+    }
+
+    return keys;
+}
+
+
+bool Computer::readKey(uint8_t key)
+{
+    m_key_reads[key]++;
+
+    if (m_key_read_cycle[key] == UINT64_MAX) {
+        m_key_read_cycle[key] = m_cycle;
+    }
+
+    // A tap shorter than the polling period of the program is not lost
+    const bool latched =
+        m_key_latched[key]
+     && m_cycle - m_key_release_cycle[key] < key_latch_frames * m_cycles_per_frame;
+
+    m_key_latched[key] = false;
+
+    return m_keypad[key] || latched;
 }
 
 
 void Computer::tick()
 {
     // Retrieve the instruction from memory
-    uint16_t instruction = m_memory[m_program_counter] << 8 | m_memory[m_program_counter + 1];
+    uint16_t instruction = fetch(m_program_counter);
+
+    exec(instruction);
+
+    m_cycle++;
+}
 
-    // Sound timer
-    if (m_sound_timer > 0) {
-        m_sound_timer -= 1;
+
+void Computer::runFrame()
+{
+    const uint64_t next_frame_cycle = (frame() + 1) * m_cycles_per_frame;
+
+    while (m_cycle < next_frame_cycle) {
+        tick();
     }
+}
 
-    if (m_delay_timer == 0) {
-        exec(instruction);
-    } else {
-        m_delay_timer -= 1;
+
+uint64_t Computer::advance(uint64_t cycle)
+{
+    uint64_t executed = 0;
+
+    while (m_cycle < cycle) {
+        const Idle idle = idleState();
+
+        if (idle == ACTIVE) {
+            executed += cycle - m_cycle;
+
+            while (m_cycle < cycle) {
+                tick();
+            }
+        } else if (idle == WAIT_DELAY) {
+            fastForward(std::min(cycle, delayExpiryCycle()) - m_cycle);
+        } else {
+            fastForward(cycle - m_cycle);
+        }
     }
+
+    return executed;
+}
+
+
+Computer::Idle Computer::idleState() const
+{
+    const uint16_t instruction = fetch(m_program_counter);
+
+    // FX0A waiting for a key press
+    if ((instruction & 0xF0FF) == 0xF00A) {
+        return (m_wait_for_key_press && !m_key_pressed_while_waiting) ? WAIT_KEY : ACTIVE;
+    }
+
+    // 1NNN jumping to itself or 00FD exiting the interpreter
+    if (instruction == (0x1000 | m_program_counter) || instruction == 0x00FD) {
+        return HALTED;
+    }
+
+    // Delay timer polling loop:
+    //   loop: FX07
+    //         3X00
+    //         1NNN (loop)
+    // The program counter can be on any of the three instructions
+    if (delayTimer() > 0) {
+        for (uint16_t offset = 0; offset <= 4; offset += 2) {
+            if (m_program_counter < offset) {
+                break;
+            }
+
+            const uint16_t loop = m_program_counter - offset;
+            const uint16_t read = fetch(loop);
+
+            if ((read & 0xF0FF) == 0xF007
+                && fetch(loop + 2) == (0x3000 | (read & 0x0F00))
+                && fetch(loop + 4) == (0x1000 | loop)) {
+                return WAIT_DELAY;
+            }
+        }
+    }
+
+    return ACTIVE;
 }
 
 
@@ -88,7 +311,7 @@ void Computer::inst_0NNN(uint16_t addr)
 
     // FIXME: not implemented
     // https://github.com/mattmikolay/chip-8/wiki/Mastering-CHIP%E2%80%908#subroutines
-    std::cout << "??" << std::endl;
+    m_diagnostics.report(Diagnostics::NATIVE_CALL, m_program_counter, addr);
     m_program_counter += 2;
 }
 
@@ -100,12 +323,216 @@ void Computer::inst_00E0()
     std::cout << "CLR_SCR";
     #endif
 
-    std::memset(&m_screen[0], 0, screen_width / 8 * screen_height);
+    // Only the selected planes are cleared
+    for (uint8_t plane = 0; plane < 2; plane++) {
+        if (m_planes & (1 << plane)) {
+            std::fill(&m_screen[plane * plane_words], &m_screen[(plane + 1) * plane_words], 0);
+        }
+    }
+
+    m_screen_generation++;
+    m_dirty_rows = ~(uint64_t)0;
+
+    m_program_counter += 2;
+}
+
+
+// Scroll the screen down by N rows
+void Computer::inst_00CN(uint8_t n)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "SCD " << int(n);
+    #endif
+
+    scrollVertically(n);
 
     m_program_counter += 2;
 }
 
 
+// Scroll the screen up by N rows
+void Computer::inst_00DN(uint8_t n)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "SCU " << int(n);
+    #endif
+
+    scrollVertically(-(int)n);
+
+    m_program_counter += 2;
+}
+
+
+// Scroll the screen right by 4 pixels
+void Computer::inst_00FB()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "SCR";
+    #endif
+
+    scrollHorizontally(true);
+
+    m_program_counter += 2;
+}
+
+
+// Scroll the screen left by 4 pixels
+void Computer::inst_00FC()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "SCL";
+    #endif
+
+    scrollHorizontally(false);
+
+    m_program_counter += 2;
+}
+
+
+// Exit the interpreter, the program counter stays on this instruction
+void Computer::inst_00FD()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "EXIT";
+    #endif
+}
+
+
+// Switch to the 64x32 low resolution and clear the screen
+void Computer::inst_00FE()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "LOW";
+    #endif
+
+    setResolution(false);
+
+    m_program_counter += 2;
+}
+
+
+// Switch to the 128x64 high resolution and clear the screen
+void Computer::inst_00FF()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "HIGH";
+    #endif
+
+    setResolution(true);
+
+    m_program_counter += 2;
+}
+
+
+void Computer::setResolution(bool hires)
+{
+    // Both planes are cleared whatever the selection
+    m_hires = hires;
+    std::fill(m_screen.begin(), m_screen.end(), 0);
+
+    m_screen_generation++;
+    m_dirty_rows = ~(uint64_t)0;
+}
+
+
+void Computer::scrollVertically(int n)
+{
+    // Rows below the current resolution are always cleared
+    const int h = height();
+    const int shift = std::min(std::abs(n), h);
+
+    if (shift == 0) {
+        return;
+    }
+
+    for (uint8_t plane = 0; plane < 2; plane++) {
+        if ((m_planes & (1 << plane)) == 0) {
+            continue;
+        }
+
+        uint64_t* rows = &m_screen[plane * plane_words];
+
+        if (n > 0) {
+            std::memmove(&rows[2 * shift], &rows[0], 2 * (h - shift) * sizeof(uint64_t));
+            std::fill(&rows[0], &rows[2 * shift], 0);
+        } else {
+            std::memmove(&rows[0], &rows[2 * shift], 2 * (h - shift) * sizeof(uint64_t));
+            std::fill(&rows[2 * (h - shift)], &rows[2 * h], 0);
+        }
+    }
+
+    m_screen_generation++;
+    m_dirty_rows = ~(uint64_t)0;
+}
+
+
+void Computer::scrollHorizontally(bool right)
+{
+    // Pixels moved past the right edge of the low resolution are cleared
+    const uint64_t right_mask = m_hires ? ~(uint64_t)0 : 0;
+
+    // A row is a 128 bits value stored as two words, the left one first.
+    // Each word is shifted by 4 bits and receives the 4 bits shifted out of
+    // its neighbour.
+    for (uint8_t plane = 0; plane < 2; plane++) {
+        if ((m_planes & (1 << plane)) == 0) {
+            continue;
+        }
+
+        scrollPlane(&m_screen[plane * plane_words], right, right_mask);
+    }
+
+    m_screen_generation++;
+    m_dirty_rows = ~(uint64_t)0;
+}
+
+
+void Computer::scrollPlane(uint64_t* rows, bool right, uint64_t right_mask)
+{
+#if defined(COMPUTER_AVX2)
+    const __m256i mask = _mm256_set_epi64x((long long)right_mask, -1, (long long)right_mask, -1);
+
+    // Two rows per iteration, the byte shifts work on each 128 bits lane
+    for (size_t i = 0; i < plane_words; i += 4) {
+        __m256i* pair = (__m256i*)&rows[i];
+        const __m256i v = _mm256_loadu_si256(pair);
+
+        const __m256i shifted = right
+            ? _mm256_or_si256(_mm256_srli_epi64(v, 4), _mm256_slli_si256(_mm256_slli_epi64(v, 60), 8))
+            : _mm256_or_si256(_mm256_slli_epi64(v, 4), _mm256_srli_si256(_mm256_srli_epi64(v, 60), 8));
+
+        _mm256_storeu_si256(pair, _mm256_and_si256(shifted, mask));
+    }
+#elif defined(COMPUTER_SSE2)
+    const __m128i mask = _mm_set_epi64x((long long)right_mask, -1);
+
+    for (size_t i = 0; i < plane_words; i += 2) {
+        __m128i* row = (__m128i*)&rows[i];
+        const __m128i v = _mm_loadu_si128(row);
+
+        const __m128i shifted = right
+            ? _mm_or_si128(_mm_srli_epi64(v, 4), _mm_slli_si128(_mm_slli_epi64(v, 60), 8))
+            : _mm_or_si128(_mm_slli_epi64(v, 4), _mm_srli_si128(_mm_srli_epi64(v, 60), 8));
+
+        _mm_storeu_si128(row, _mm_and_si128(shifted, mask));
+    }
+#else
+    for (size_t i = 0; i < plane_words; i += 2) {
+        const uint64_t left_word  = rows[i];
+        const uint64_t right_word = rows[i + 1];
+
+        if (right) {
+            rows[i]     = left_word >> 4;
+            rows[i + 1] = ((right_word >> 4) | (left_word << 60)) & right_mask;
+        } else {
+            rows[i]     = (left_word << 4) | (right_word >> 60);
+            rows[i + 1] = (right_word << 4) & right_mask;
+        }
+    }
+#endif
+}
+
+
 // Return from a subroutine
 void Computer::inst_00EE()
 {
@@ -113,6 +540,13 @@ void Computer::inst_00EE()
     std::cout << "RET";
     #endif
 
+    // Returning from the main program, carry on as if it was a NOP
+    if (m_stack.empty()) {
+        m_diagnostics.report(Diagnostics::STACK_UNDERFLOW, m_program_counter, 0x00EE);
+        m_program_counter += 2;
+        return;
+    }
+
     m_program_counter = m_stack.back();
     m_stack.pop_back();
 
@@ -138,6 +572,17 @@ void Computer::inst_2NNN(uint16_t addr)
     std::cout << "CALL 0x" << std::hex << addr;
     #endif
 
+    // The original interpreters had room for 12 to 16 return addresses,
+    // programs going deeper are recursing by mistake
+    if (m_stack.size() >= max_stack_depth) {
+        m_diagnostics.report(Diagnostics::STACK_OVERFLOW, m_program_counter, 0x2000 | addr);
+
+        // Keep the memory bounded, the oldest return address is lost
+        if (m_stack.size() >= max_stack_depth * 64) {
+            m_stack.erase(m_stack.begin());
+        }
+    }
+
     m_stack.push_back(m_program_counter);
     m_program_counter = addr;
 }
@@ -151,7 +596,7 @@ void Computer::inst_3XNN(uint8_t reg_x, uint8_t value)
     #endif
 
     if (m_registers[reg_x] == value) {
-        m_program_counter += 4;
+        skip();
     } else {
         m_program_counter += 2;
     }
@@ -166,7 +611,7 @@ void Computer::inst_4XNN(uint8_t reg_x, uint8_t value)
     #endif
 
     if (m_registers[reg_x] != value) {
-        m_program_counter += 4;
+        skip();
     } else {
         m_program_counter += 2;
     }
@@ -182,13 +627,51 @@ void Computer::inst_5XY0(uint8_t reg_x, uint8_t reg_y)
     #endif
 
     if (m_registers[reg_x] == m_registers[reg_y]) {
-        m_program_counter += 4;
+        skip();
     } else {
         m_program_counter += 2;
     }
 }
 
 
+// Store the registers VX to VY inclusive in memory starting at address I, in
+// reverse order if X > Y. I is unchanged.
+void Computer::inst_5XY2(uint8_t reg_x, uint8_t reg_y)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "STR_Vxy v" << std::hex << (int)(reg_x) << " v" << std::hex << (int)(reg_y);
+    #endif
+
+    const int step = (reg_x <= reg_y) ? 1 : -1;
+    const int count = std::abs(reg_y - reg_x) + 1;
+
+    for (int i = 0; i < count; i++) {
+        m_memory[(uint16_t)(m_I_register + i)] = m_registers[reg_x + i * step];
+    }
+
+    m_program_counter += 2;
+}
+
+
+// Load the registers VX to VY inclusive from memory starting at address I, in
+// reverse order if X > Y. I is unchanged.
+void Computer::inst_5XY3(uint8_t reg_x, uint8_t reg_y)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "LOAD_Vxy v" << std::hex << (int)(reg_x) << " v" << std::hex << (int)(reg_y);
+    #endif
+
+    const int step = (reg_x <= reg_y) ? 1 : -1;
+    const int count = std::abs(reg_y - reg_x) + 1;
+
+    for (int i = 0; i < count; i++) {
+        m_registers[reg_x + i * step] = m_memory[(uint16_t)(m_I_register + i)];
+    }
+
+    m_program_counter += 2;
+}
+
+
 // Store number NN in register VX
 void Computer::inst_6XNN(uint8_t reg_x, uint8_t value)
 {
@@ -327,11 +810,7 @@ void Computer::inst_8XY6(uint8_t reg_x, uint8_t reg_y)
     std::cout << "SHFT_R v" << std::hex << (int)(reg_x) << " v" << std::hex << (int)(reg_y);
     #endif
 
-    #ifdef ALT_SHIFT
-    const uint8_t v = m_registers[reg_x];
-    #else
-    const uint8_t v = m_registers[reg_y];
-    #endif
+    const uint8_t v = m_quirks.shift_vx ? m_registers[reg_x] : m_registers[reg_y];
 
     m_registers[reg_x] = v >> 1;
     m_registers[0xF]   = v & 0x01;
@@ -375,11 +854,7 @@ void Computer::inst_8XYE(uint8_t reg_x, uint8_t reg_y)
     std::cout << "SHFT_L v" << std::hex << (int)(reg_x) << " v" << std::hex << (int)(reg_y);
     #endif
 
-    #ifdef ALT_SHIFT
-    const uint8_t v = m_registers[reg_x];
-    #else
-    const uint8_t v = m_registers[reg_y];
-    #endif
+    const uint8_t v = m_quirks.shift_vx ? m_registers[reg_x] : m_registers[reg_y];
 
     m_registers[reg_x] = v << 1;
     m_registers[0xF]   = (v & 0x80) >> 7;
@@ -397,7 +872,7 @@ void Computer::inst_9XY0(uint8_t reg_x, uint8_t reg_y)
     #endif
 
     if (m_registers[reg_x] != m_registers[reg_y]) {
-        m_program_counter += 4;
+        skip();
     } else {
         m_program_counter += 2;
     }
@@ -435,9 +910,8 @@ void Computer::inst_CXNN(uint8_t reg_x, uint8_t mask)
     std::cout << "RND v" << std::hex << (int)(reg_x) << " 0x" << std::hex << mask;
     #endif
 
-    const float rng_c = (float)std::rand() / (float)(RAND_MAX - 1);
-    uint8_t rng = (uint8_t)std::round((float)0xFF * rng_c);
-    m_registers[reg_x] = rng & mask;
+    // The upper bits of PCG are the best distributed
+    m_registers[reg_x] = (uint8_t)(m_rng.next() >> 24) & mask;
 
     m_program_counter += 2;
 }
@@ -452,44 +926,70 @@ void Computer::inst_DXYN(uint8_t reg_x, uint8_t reg_y, uint8_t n_bytes)
     std::cout << "DRAW v" << std::hex << (int)(reg_x) << " v" << std::hex << (int)(reg_y) << " " << int(n_bytes);
     #endif
 
-    const uint8_t start_x = m_registers[reg_x] % screen_width;
-    const uint8_t start_y = m_registers[reg_y] % screen_height;
+    const uint8_t start_x = m_registers[reg_x] % width();
+    const uint8_t start_y = m_registers[reg_y] % height();
 
-    // This could be enhanced...
-    m_registers[0xF] = 0x00;
+    // DXY0 draws a 16x16 sprite of 2 bytes per row
+    const uint8_t n_rows    = (n_bytes == 0) ? 16 : n_bytes;
+    const uint8_t row_bytes = (n_bytes == 0) ? 2 : 1;
 
-    for (uint8_t y = start_y; y < start_y + n_bytes && y < screen_height; y++) {
-        const uint8_t mem_val = m_memory[m_I_register + (y - start_y)];
+    const uint8_t end_y = std::min(start_y + n_rows, (int)height());
 
-        for (uint8_t b = 0; b < 8; b++) {
-            const uint8_t x_b = (start_x + b) / 8;
+    checkAccess(n_rows * row_bytes * ((m_planes == 0x3) ? 2 : 1));
 
-            if (start_x + b < screen_width) {
-                const uint8_t screen_curr_val = m_screen[y * (screen_width/8) + x_b];
-                const uint8_t screen_bit_offset = (start_x + b) % 8;
-                const uint8_t screen_bit_mask = 1 << (7 - screen_bit_offset);
-                const uint8_t screen_curr_b = ((screen_curr_val & screen_bit_mask) != 0);
+    if (end_y > start_y) {
+        m_screen_generation++;
+        m_dirty_rows |= ((~(uint64_t)0) >> (64 - (end_y - start_y))) << start_y;
+    }
+
+    // Pixels past the right edge of the low resolution are clipped
+    const uint64_t right_mask = m_hires ? ~(uint64_t)0 : 0;
+
+    uint64_t collisions = 0;
+
+    // With both XO-CHIP planes selected, the sprite data of the second plane
+    // follows the one of the first
+    uint16_t sprite_addr = m_I_register;
+
+    for (uint8_t plane = 0; plane < 2; plane++) {
+        if ((m_planes & (1 << plane)) == 0) {
+            continue;
+        }
+
+        uint64_t* rows = &m_screen[plane * plane_words];
+
+        for (uint8_t y = start_y; y < end_y; y++) {
+            const uint16_t addr = sprite_addr + row_bytes * (y - start_y);
 
-                const uint8_t mem_bit_offset = b;
-                const uint8_t mem_bit_mask = 1 << (7 - mem_bit_offset);
-                const uint8_t mem_curr_b = ((mem_val & mem_bit_mask) != 0);
-                const uint8_t new_screen_curr_b = screen_curr_b ^ mem_curr_b;
+            // The sprite row on the left of the screen row, then shifted in
+            // place. The pixels past the right edge are shifted out.
+            const uint64_t sprite = (row_bytes == 2)
+                ? (uint64_t)fetch(addr) << 48
+                : (uint64_t)m_memory[addr] << 56;
 
-                // TODO:Check if flip from set to unset happend
-                if (screen_curr_b && !new_screen_curr_b) {
-                    m_registers[0xF] = 0x01;
-                }
+            uint64_t left, right;
 
-                if (new_screen_curr_b) {
-                    m_screen[y * (screen_width/8) + x_b] |= 1 << (7 - screen_bit_offset);
-                }
-                else {
-                    m_screen[y * (screen_width/8) + x_b] &= ~(1 << (7 - screen_bit_offset));
-                }
+            if (start_x < 64) {
+                left  = sprite >> start_x;
+                right = (start_x > 0) ? (sprite << (64 - start_x)) & right_mask : 0;
+            } else {
+                left  = 0;
+                right = (sprite >> (start_x - 64)) & right_mask;
             }
+
+            uint64_t* row = &rows[2 * y];
+
+            collisions |= (row[0] & left) | (row[1] & right);
+            row[0] ^= left;
+            row[1] ^= right;
         }
+
+        sprite_addr += n_rows * row_bytes;
     }
 
+    // A collision is a set pixel cleared by the sprite
+    m_registers[0xF] = (collisions != 0) ? 0x01 : 0x00;
+
     m_program_counter += 2;
 }
 
@@ -504,8 +1004,8 @@ void Computer::inst_EX9E(uint8_t reg_x)
 
     uint8_t hex_v = m_registers[reg_x];
 
-    if (hex_v <= 0xF && m_keypad[hex_v]) {
-        m_program_counter += 4;
+    if (hex_v <= 0xF && readKey(hex_v)) {
+        skip();
     } else {
         m_program_counter += 2;
     }
@@ -522,14 +1022,73 @@ void Computer::inst_EXA1(uint8_t reg_x)
 
     uint8_t hex_v = m_registers[reg_x];
 
-    if (hex_v <= 0xF && !m_keypad[hex_v]) {
-        m_program_counter += 4;
+    if (hex_v <= 0xF && !readKey(hex_v)) {
+        skip();
     } else {
         m_program_counter += 2;
     }
 }
 
 
+// Load the 16 bits address following this instruction in I
+void Computer::inst_F000()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "LOAD_I_LONG " << std::hex << fetch(m_program_counter + 2);
+    #endif
+
+    m_I_register = fetch(m_program_counter + 2);
+    m_long_addressing = true;
+
+    m_program_counter += 4;
+}
+
+
+// Select the planes drawn, cleared and scrolled, as a bitmask
+void Computer::inst_FN01(uint8_t planes)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "PLANE " << int(planes);
+    #endif
+
+    m_planes = planes & 0x3;
+
+    m_program_counter += 2;
+}
+
+
+// Load the 16 bytes audio pattern buffer from memory starting at address I
+void Computer::inst_F002()
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "AUDIO";
+    #endif
+
+    for (uint8_t i = 0; i < m_audio_pattern.size(); i++) {
+        m_audio_pattern[i] = m_memory[(uint16_t)(m_I_register + i)];
+    }
+
+    m_audio_pattern_set = true;
+    m_audio_generation++;
+
+    m_program_counter += 2;
+}
+
+
+// Set the playback rate of the audio pattern from the value of register VX
+void Computer::inst_FX3A(uint8_t reg_x)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "PITCH v" << std::hex << (int)(reg_x);
+    #endif
+
+    m_audio_pitch = m_registers[reg_x];
+    m_audio_generation++;
+
+    m_program_counter += 2;
+}
+
+
 // Store the current value of the delay timer in register VX
 void Computer::inst_FX07(uint8_t reg_x)
 {
@@ -537,7 +1096,7 @@ void Computer::inst_FX07(uint8_t reg_x)
     std::cout << "STR_DELAY v" << std::hex << (int)(reg_x);
     #endif
 
-    m_registers[reg_x] = m_delay_timer;
+    m_registers[reg_x] = (uint8_t)delayTimer();
 
     m_program_counter += 2;
 }
@@ -550,10 +1109,12 @@ void Computer::inst_FX0A(uint8_t reg_x)
     std::cout << "WAIT_K v" << std::hex << (int)(reg_x);
     #endif
 
-    // The instruction has to finish
-    if (m_wait_for_key_press) {
+    // The instruction finishes once a key was pressed after it started
+    if (m_wait_for_key_press && m_key_pressed_while_waiting) {
         m_wait_for_key_press = false;
+        m_key_pressed_while_waiting = false;
         m_registers[reg_x] = m_last_key_pressed;
+        readKey(m_last_key_pressed);
 
         m_program_counter += 2;
     } else {
@@ -571,7 +1132,7 @@ void Computer::inst_FX15(uint8_t reg_x)
     std::cout << "DELAY v" << std::hex << (int)(reg_x);
     #endif
 
-    m_delay_timer = m_registers[reg_x];
+    m_delay_expiry = frame() + m_registers[reg_x];
 
     m_program_counter += 2;
 }
@@ -584,7 +1145,19 @@ void Computer::inst_FX18(uint8_t reg_x)
     std::cout << "SOUND v" << std::hex << (int)(reg_x);
     #endif
 
-    m_sound_timer = m_registers[reg_x];
+    const uint8_t value = m_registers[reg_x];
+    const bool playing = soundTimer() > 0 && m_sound_start_cycle <= m_cycle;
+
+    m_sound_expiry = frame() + value;
+
+    // As noted in the COSMAC VIP manual, the minimum value that the timer
+    // will respond to is 0x02. Thus, setting the timer to a value of 0x01
+    // will have no audible effect.
+    if (value < 0x02) {
+        m_sound_start_cycle = UINT64_MAX;
+    } else if (!playing) {
+        m_sound_start_cycle = m_cycle;
+    }
 
     m_program_counter += 2;
 }
@@ -617,6 +1190,19 @@ void Computer::inst_FX29(uint8_t reg_x)
 }
 
 
+// Set I to the location of the 8x10 sprite for the digit in register VX
+void Computer::inst_FX30(uint8_t reg_x)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "HEX 0x" << std::hex << (int)(reg_x);
+    #endif
+
+    m_I_register = big_font_address + ((uint16_t)m_registers[reg_x] & 0xF) * 10;
+
+    m_program_counter += 2;
+}
+
+
 // Store the binary-coded decimal equivalent of the value stored in register VX
 // at addresses I, I + 1, and I + 2
 void Computer::inst_FX33(uint8_t reg_x)
@@ -631,9 +1217,11 @@ void Computer::inst_FX33(uint8_t reg_x)
     const uint8_t b = (vx - a * 100) / 10;
     const uint8_t c = (vx - a * 100 - b * 10);
 
-    m_memory[m_I_register + 0] = a;
-    m_memory[m_I_register + 1] = b;
-    m_memory[m_I_register + 2] = c;
+    checkAccess(3);
+
+    m_memory[m_I_register] = a;
+    m_memory[(uint16_t)(m_I_register + 1)] = b;
+    m_memory[(uint16_t)(m_I_register + 2)] = c;
 
     m_program_counter += 2;
 }
@@ -648,17 +1236,18 @@ void Computer::inst_FX55(uint8_t reg_x)
     std::cout << "STR_Vn 0x" << std::hex << (int)(reg_x);
     #endif
 
-    // for (uint8_t reg = 0; reg <= reg_x; reg++) {
-    //     m_memory[m_I_register + reg] = m_registers[reg];
-    // }
+    checkAccess((uint16_t)reg_x + 1);
 
-    std::memcpy(&m_memory[m_I_register], &m_registers[0], reg_x + 1);
+    // Addresses wrap around the 64 KiB
+    for (uint8_t reg = 0; reg <= reg_x; reg++) {
+        m_memory[(uint16_t)(m_I_register + reg)] = m_registers[reg];
+    }
 
     // Implementation dependent:
     // https://github.com/mattmikolay/chip-8/wiki/CHIP%E2%80%908-Instruction-Set#notes
-    #ifdef ALT_STR_LD
-    m_I_register += (uint16_t)reg_x + 1;
-    #endif
+    if (m_quirks.load_store_increment) {
+        m_I_register += (uint16_t)reg_x + 1;
+    }
 
     m_program_counter += 2;
 }
@@ -673,18 +1262,45 @@ void Computer::inst_FX65(uint8_t reg_x)
     std::cout << "LOAD_Vn 0x" << std::hex << (int)(reg_x);
     #endif
 
-    // for (uint8_t reg = 0; reg <= reg_x; reg++) {
-    //     m_registers[reg] = m_memory[m_I_register + reg];
-    // }
+    checkAccess((uint16_t)reg_x + 1);
 
-    std::memcpy(&m_registers[0], &m_memory[m_I_register], reg_x + 1);
+    // Addresses wrap around the 64 KiB
+    for (uint8_t reg = 0; reg <= reg_x; reg++) {
+        m_registers[reg] = m_memory[(uint16_t)(m_I_register + reg)];
+    }
 
     // Implementation dependent:
     // https://github.com/mattmikolay/chip-8/wiki/CHIP%E2%80%908-Instruction-Set#notes
-    #ifdef ALT_STR_LD
-    m_I_register += (uint16_t)reg_x + 1;
+    if (m_quirks.load_store_increment) {
+        m_I_register += (uint16_t)reg_x + 1;
+    }
+
+    m_program_counter += 2;
+}
+
+
+// Save the registers V0 to VX inclusive in the RPL user flags
+void Computer::inst_FX75(uint8_t reg_x)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "STR_RPL 0x" << std::hex << (int)(reg_x);
+    #endif
+
+    std::memcpy(&m_rpl_flags[0], &m_registers[0], reg_x + 1);
+
+    m_program_counter += 2;
+}
+
+
+// Restore the registers V0 to VX inclusive from the RPL user flags
+void Computer::inst_FX85(uint8_t reg_x)
+{
+    #ifdef PRINT_OPCODE
+    std::cout << "LOAD_RPL 0x" << std::hex << (int)(reg_x);
     #endif
 
+    std::memcpy(&m_registers[0], &m_rpl_flags[0], reg_x + 1);
+
     m_program_counter += 2;
 }
 
@@ -710,6 +1326,41 @@ void Computer::exec(uint16_t instruction)
         // Return from a subroutine
         inst_00EE();
     }
+    // 00CN
+    else if ((instruction & 0xFFF0) == 0x00C0) {
+        // Scroll the screen down by N rows
+        inst_00CN(n);
+    }
+    // 00DN
+    else if ((instruction & 0xFFF0) == 0x00D0) {
+        // Scroll the screen up by N rows
+        inst_00DN(n);
+    }
+    // 00FB
+    else if (instruction == 0x00FB) {
+        // Scroll the screen right by 4 pixels
+        inst_00FB();
+    }
+    // 00FC
+    else if (instruction == 0x00FC) {
+        // Scroll the screen left by 4 pixels
+        inst_00FC();
+    }
+    // 00FD
+    else if (instruction == 0x00FD) {
+        // Exit the interpreter
+        inst_00FD();
+    }
+    // 00FE
+    else if (instruction == 0x00FE) {
+        // Switch to low resolution
+        inst_00FE();
+    }
+    // 00FF
+    else if (instruction == 0x00FF) {
+        // Switch to high resolution
+        inst_00FF();
+    }
     // 0NNN
     else if ((instruction & 0xF000) == 0x0000) {
         // Execute machine language subroutine at address NNN
@@ -737,11 +1388,23 @@ void Computer::exec(uint16_t instruction)
         inst_4XNN(reg_x, nn);
     }
     // 5XY0
-    else if ((instruction & 0xF000) == 0x5000) {
+    else if ((instruction & 0xF00F) == 0x5000) {
         // Skip the following instruction if the value of register VX is equal
         // to the value of register VY
         inst_5XY0(reg_x, reg_y);
     }
+    // 5XY2
+    else if ((instruction & 0xF00F) == 0x5002) {
+        // Store the registers VX to VY inclusive in memory starting at
+        // address I
+        inst_5XY2(reg_x, reg_y);
+    }
+    // 5XY3
+    else if ((instruction & 0xF00F) == 0x5003) {
+        // Load the registers VX to VY inclusive from memory starting at
+        // address I
+        inst_5XY3(reg_x, reg_y);
+    }
     // 6XNN
     else if ((instruction & 0xF000) == 0x6000) {
         // Store number NN in register VX
@@ -847,6 +1510,21 @@ void Computer::exec(uint16_t instruction)
         // value currently stored in register VX is not pressed
         inst_EXA1(reg_x);
     }
+    // F000 NNNN
+    else if (instruction == 0xF000) {
+        // Load the following 16 bits address in I
+        inst_F000();
+    }
+    // FN01
+    else if ((instruction & 0xF0FF) == 0xF001) {
+        // Select the drawing planes
+        inst_FN01(reg_x);
+    }
+    // F002
+    else if (instruction == 0xF002) {
+        // Load the audio pattern from memory starting at address I
+        inst_F002();
+    }
     // FX07
     else if ((instruction & 0xF0FF) == 0xF007) {
         // Store the current value of the delay timer in register VX
@@ -878,12 +1556,22 @@ void Computer::exec(uint16_t instruction)
         // hexadecimal digit stored in register VX
         inst_FX29(reg_x);
     }
+    // FX30
+    else if ((instruction & 0xF0FF) == 0xF030) {
+        // Set I to the location of the big sprite for the digit in VX
+        inst_FX30(reg_x);
+    }
     // FX33
     else if ((instruction & 0xF0FF) == 0xF033) {
         // Store the binary-coded decimal equivalent of the value stored in
         // register VX at addresses I, I + 1, and I + 2
         inst_FX33(reg_x);
     }
+    // FX3A
+    else if ((instruction & 0xF0FF) == 0xF03A) {
+        // Set the pitch of the audio pattern from VX
+        inst_FX3A(reg_x);
+    }
     // FX55
     else if ((instruction & 0xF0FF) == 0xF055) {
         // Store the values of registers V0 to VX inclusive in memory starting
@@ -898,8 +1586,18 @@ void Computer::exec(uint16_t instruction)
         // I is set to I + X + 1 after operation²
         inst_FX65(reg_x);
     }
+    // FX75
+    else if ((instruction & 0xF0FF) == 0xF075) {
+        // Save V0 to VX inclusive in the RPL user flags
+        inst_FX75(reg_x);
+    }
+    // FX85
+    else if ((instruction & 0xF0FF) == 0xF085) {
+        // Restore V0 to VX inclusive from the RPL user flags
+        inst_FX85(reg_x);
+    }
     else {
-        std::cout << "OpCode? " << std::hex << instruction << std::endl;
+        m_diagnostics.report(Diagnostics::UNKNOWN_OPCODE, m_program_counter, instruction);
         m_program_counter += 2;
     }
 
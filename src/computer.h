@@ -1,43 +1,257 @@
 #pragma once
 
+#include <diagnostics.h>
+#include <rng.h>
+
 #include <array>
 #include <vector>
 #include <cstdint>
+#include <string>
 
+// Default quirks, see Quirks
 #define ALT_SHIFT
 // #define ALT_STR_LD
 
 // #define PRINT_OPCODE
 
+// Instructions on which the CHIP-8 interpreters disagree, chosen per ROM.
+// The defaults follow the ALT_SHIFT and ALT_STR_LD defines.
+struct Quirks {
+    // 8XY6 and 8XYE shift VX in place instead of VY
+    #ifdef ALT_SHIFT
+    bool shift_vx = true;
+    #else
+    bool shift_vx = false;
+    #endif
+
+    // FX55 and FX65 leave I past the last register
+    #ifdef ALT_STR_LD
+    bool load_store_increment = true;
+    #else
+    bool load_store_increment = false;
+    #endif
+
+    bool operator==(const Quirks& other) const
+    {
+        return shift_vx == other.shift_vx && load_store_increment == other.load_store_increment;
+    }
+
+    // Comma separated names as given to --quirks, "none" if none is set
+    std::string name() const;
+
+    // One bit per quirk, as stored in movies and the ROM database
+    uint8_t bits() const
+    {
+        return (shift_vx ? 0x01 : 0x00) | (load_store_increment ? 0x02 : 0x00);
+    }
+
+    static Quirks fromBits(uint8_t bits)
+    {
+        Quirks quirks;
+        quirks.shift_vx             = (bits & 0x01) != 0;
+        quirks.load_store_increment = (bits & 0x02) != 0;
+        return quirks;
+    }
+
+    // Returns false on an unknown name
+    static bool parse(const std::string& names, Quirks& quirks);
+};
+
+
 class Computer
 {
 public:
-    Computer(const std::vector<uint8_t> &program);
+    // What the program is waiting for when it does not make progress
+    enum Idle {
+        ACTIVE,     // The program is running
+        WAIT_DELAY, // Polling the delay timer until it reaches 0
+        WAIT_KEY,   // Blocked in FX0A until a key is pressed
+        HALTED      // Jumping to itself forever
+    };
+
+    // CXNN draws from a generator of its own, the same seed and inputs
+    // always give the same run
+    Computer(
+        const std::vector<uint8_t> &program,
+        uint32_t cycles_per_frame = 10,
+        uint64_t seed = 0,
+        const Quirks& quirks = Quirks());
 
+    // A key released before the program read it through EX9E, EXA1 or FX0A
+    // still reads as pressed once, for up to key_latch_frames frames
     void keyPress(uint8_t key);
     void keyRelease(uint8_t key);
 
+    static constexpr uint32_t key_latch_frames = 4;
+
+    // Execute a single instruction
     void tick();
 
-    uint8_t width()  const { return screen_width; }
-    uint8_t height() const { return screen_height; }
+    // Execute instructions up to the start of the next 60 Hz frame
+    void runFrame();
+
+    // Run up to the given cycle, idle periods being skipped instead of
+    // interpreted: up to the delay timer expiry while the program polls it,
+    // up to the given cycle otherwise. Returns the number of instructions
+    // executed. The result only depends on the cycles the run is split at.
+    uint64_t advance(uint64_t cycle);
+
+    // Advance the clock without executing any instruction. This lets a
+    // program waiting on the delay timer reach its expiry in constant time.
+    void fastForward(uint64_t cycles) { m_cycle += cycles; }
+
+    // Frequency of the delay and sound timers
+    static constexpr uint32_t timer_Hz = 60;
+
+    // Number of instructions executed since power on
+    uint64_t cycle() const { return m_cycle; }
+
+    uint32_t cyclesPerFrame() const { return m_cycles_per_frame; }
+
+    // Cycle at which the delay timer reaches 0
+    uint64_t delayExpiryCycle() const { return m_delay_expiry * m_cycles_per_frame; }
+
+    // Detect if the program is in an idle loop. Until the event it waits for
+    // happens, running it only advances the clock.
+    Idle idleState() const;
+
+    // The SUPER-CHIP high resolution mode is 128x64, the low resolution
+    // 64x32
+    bool hires() const { return m_hires; }
+
+    uint8_t width()  const { return m_hires ? max_width  : max_width / 2; }
+    uint8_t height() const { return m_hires ? max_height : max_height / 2; }
+
+    // The timers are only evaluated when read
+    uint16_t delayTimer() const { return timerValue(m_delay_expiry); }
+    uint16_t soundTimer() const { return timerValue(m_sound_expiry); }
+
+    // The sound plays from the cycle FX18 started it until the sound timer
+    // reaches 0. Reloading the timer while it plays extends the sound.
+    uint64_t soundStartCycle() const { return m_sound_start_cycle; }
+    uint64_t soundExpiryCycle() const { return m_sound_expiry * m_cycles_per_frame; }
+
+    // The two XO-CHIP planes one after the other. Two words per row, the
+    // leftmost pixel in the most significant bit of the first one. In low
+    // resolution only the upper left quarter is used.
+    const std::vector<uint64_t>& screen() const { return m_screen; }
+
+    // Copy a plane in the current resolution as width / 8 bytes per row,
+    // most significant bit first
+    void screenBits(uint8_t* out, uint8_t plane = 0) const;
+
+    // 2 if the second plane has any pixel set, 1 otherwise
+    uint8_t planeCount() const;
+
+    // XO-CHIP audio pattern, 128 samples of 1 bit played in a loop while the
+    // sound timer is active. Programs which never load one use a beeper.
+    bool hasAudioPattern() const { return m_audio_pattern_set; }
+    const std::array<uint8_t, 16>& audioPattern() const { return m_audio_pattern; }
+
+    // Samples per second, derived from the pitch register
+    float audioPatternRate() const;
+
+    // Incremented each time the pattern or the pitch changes
+    uint64_t audioGeneration() const { return m_audio_generation; }
+
+    uint64_t seed() const { return m_seed; }
+
+    const Quirks& quirks() const { return m_quirks; }
 
-    uint16_t delayTimer() const { return m_delay_timer; }
-    uint16_t soundTimer() const { return m_sound_timer; }
+    // Registers, for debugging and the shared state export
+    const std::array<uint8_t, 16>& registers() const { return m_registers; }
+    uint16_t indexRegister() const { return m_I_register; }
+    uint16_t programCounter() const { return m_program_counter; }
 
-    const std::vector<uint8_t>& screen() const { return m_screen; }
+    // Return addresses, the last call at the back
+    const std::vector<uint16_t>& stack() const { return m_stack; }
+
+    // Bit N set while key N is down
+    uint16_t keysDown() const;
+
+    // Incremented each time the program draws or clears the screen
+    uint64_t screenGeneration() const { return m_screen_generation; }
+
+    // Bitmask of the screen rows drawn since the last call, bit N for row N
+    uint64_t takeDirtyRows()
+    {
+        const uint64_t dirty_rows = m_dirty_rows;
+        m_dirty_rows = 0;
+        return dirty_rows;
+    }
+
+    // Number of times the program observed the given key through EX9E, EXA1
+    // or FX0A
+    uint32_t keyReads(uint8_t key) const { return m_key_reads[key]; }
+
+    // Cycle of the first read of the given key since it was last pressed or
+    // released, UINT64_MAX if it was not read since
+    uint64_t keyReadCycle(uint8_t key) const { return m_key_read_cycle[key]; }
+
+    Diagnostics& diagnostics() { return m_diagnostics; }
 
 protected:
+    uint64_t frame() const { return m_cycle / m_cycles_per_frame; }
+
+    uint16_t timerValue(uint64_t expiry_frame) const
+    {
+        const uint64_t f = frame();
+        return expiry_frame > f ? (uint16_t)(expiry_frame - f) : 0;
+    }
+
+    // State of a key read by the program, consumes its latch
+    bool readKey(uint8_t key);
+
+    // Classic programs only address the first 4 KiB, I goes past it when
+    // they run with the wrong quirks. XO-CHIP programs loading I with F000
+    // NNNN or larger than 3.5 KiB can use the whole memory.
+    void checkAccess(uint16_t size)
+    {
+        if (!m_long_addressing && m_I_register + size > 0x1000) {
+            m_diagnostics.report(Diagnostics::OUT_OF_BOUNDS, m_program_counter, fetch(m_program_counter));
+        }
+    }
+
+    uint16_t fetch(uint16_t addr) const
+    {
+        return m_memory[addr] << 8 | m_memory[(uint16_t)(addr + 1)];
+    }
+
+    // Step over the next instruction, the XO-CHIP F000 NNNN is 4 bytes long
+    void skip()
+    {
+        m_program_counter += (fetch(m_program_counter + 2) == 0xF000) ? 6 : 4;
+    }
+
     void exec(uint16_t inst);
 
+    // Clear both planes in the given resolution
+    void setResolution(bool hires);
+
+    // The selected planes are scrolled down by n rows, up if negative
+    void scrollVertically(int n);
+
+    // The selected planes are scrolled by 4 pixels
+    void scrollHorizontally(bool right);
+    static void scrollPlane(uint64_t* rows, bool right, uint64_t right_mask);
+
     void inst_0NNN(uint16_t addr);
+    void inst_00CN(uint8_t n);
+    void inst_00DN(uint8_t n);
     void inst_00E0();
     void inst_00EE();
+    void inst_00FB();
+    void inst_00FC();
+    void inst_00FD();
+    void inst_00FE();
+    void inst_00FF();
     void inst_1NNN(uint16_t addr);
     void inst_2NNN(uint16_t addr);
     void inst_3XNN(uint8_t reg_x, uint8_t value);
     void inst_4XNN(uint8_t reg_x, uint8_t value);
     void inst_5XY0(uint8_t reg_x, uint8_t reg_y);
+    void inst_5XY2(uint8_t reg_x, uint8_t reg_y);
+    void inst_5XY3(uint8_t reg_x, uint8_t reg_y);
     void inst_6XNN(uint8_t reg_x, uint8_t value);
     void inst_7XNN(uint8_t reg_x, uint8_t value);
     void inst_8XY0(uint8_t reg_x, uint8_t reg_y);
@@ -56,32 +270,62 @@ protected:
     void inst_DXYN(uint8_t reg_x, uint8_t reg_y, uint8_t n_bytes);
     void inst_EX9E(uint8_t reg_x);
     void inst_EXA1(uint8_t reg_x);
+    void inst_F000();
+    void inst_FN01(uint8_t planes);
+    void inst_F002();
     void inst_FX07(uint8_t reg_x);
     void inst_FX0A(uint8_t reg_x);
     void inst_FX15(uint8_t reg_x);
     void inst_FX18(uint8_t reg_x);
     void inst_FX1E(uint8_t reg_x);
     void inst_FX29(uint8_t reg_x);
+    void inst_FX30(uint8_t reg_x);
     void inst_FX33(uint8_t reg_x);
+    void inst_FX3A(uint8_t reg_x);
     void inst_FX55(uint8_t reg_x);
     void inst_FX65(uint8_t reg_x);
+    void inst_FX75(uint8_t reg_x);
+    void inst_FX85(uint8_t reg_x);
 
 protected:
     std::array<uint8_t, 16> m_registers;
 
     bool m_wait_for_key_press;
+    bool m_key_pressed_while_waiting;
     uint8_t m_last_key_pressed;
 
-    uint16_t m_delay_timer;
-    uint16_t m_sound_timer;
+    uint64_t m_cycle;
+    uint32_t m_cycles_per_frame;
+
+    // Frames at which the timers reach 0
+    uint64_t m_delay_expiry;
+    uint64_t m_sound_expiry;
+
+    // UINT64_MAX when the sound timer was last loaded with a value too short
+    // to be heard
+    uint64_t m_sound_start_cycle;
+
+    Quirks m_quirks;
+
     uint16_t m_I_register;
+
+    // Set once I can legitimately address past 4 KiB
+    bool m_long_addressing;
     uint16_t m_program_counter;
     std::vector<uint16_t> m_stack;
-    std::array<uint8_t, 0xFFFF> m_memory;
+    std::array<uint8_t, 0x10000> m_memory;
 
     // std::uint16_t m_stack_pointer;
-    static constexpr uint8_t screen_width  = 0x3F + 1;
-    static constexpr uint8_t screen_height = 0x1F + 1;
+    static constexpr size_t max_stack_depth = 16;
+
+    static constexpr uint8_t max_width  = 128;
+    static constexpr uint8_t max_height = 64;
+
+    // Words in each plane
+    static constexpr size_t plane_words = 2 * max_height;
+
+    // Address of the 8x10 SUPER-CHIP digits, after the 4x5 ones
+    static constexpr uint16_t big_font_address = 16 * 5;
 
     static constexpr uint8_t char_0[5] = {0xF0, 0x90, 0x90, 0x90, 0xF0};
     static constexpr uint8_t char_1[5] = {0x20, 0x60, 0x20, 0x20, 0x70};
@@ -100,7 +344,51 @@ protected:
     static constexpr uint8_t char_E[5] = {0xF0, 0x80, 0xF0, 0x80, 0xF0};
     static constexpr uint8_t char_F[5] = {0xF0, 0x80, 0xF0, 0x80, 0x80};
 
-    // std::array<uint8_t, screen_width * screen_height> m_screen;
-    std::vector<uint8_t> m_screen;
+    static constexpr uint8_t big_font[16 * 10] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+
+    // A row fits in two words so DXYN draws a whole sprite row at once
+    std::vector<uint64_t> m_screen;
+    bool m_hires;
+
+    // Planes selected by FN01, bit 0 for the first one
+    uint8_t m_planes;
+    uint64_t m_screen_generation;
+    uint64_t m_dirty_rows;
     std::array<bool, 16> m_keypad;
+    std::array<uint32_t, 16> m_key_reads;
+    std::array<uint64_t, 16> m_key_read_cycle;
+
+    // Keys pressed and not read since, with the cycle they were released at
+    std::array<bool, 16> m_key_latched;
+    std::array<uint64_t, 16> m_key_release_cycle;
+
+    // SUPER-CHIP RPL user flags, saved and restored by FX75 and FX85
+    std::array<uint8_t, 16> m_rpl_flags;
+
+    std::array<uint8_t, 16> m_audio_pattern;
+    bool m_audio_pattern_set;
+    uint8_t m_audio_pitch;
+    uint64_t m_audio_generation;
+
+    uint64_t m_seed;
+    Pcg32 m_rng;
+
+    Diagnostics m_diagnostics;
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include <diagnostics.h>
+
+#include <iomanip>
+
+
+Diagnostics::Diagnostics()
+    : m_dropped(0)
+    , m_window_start(std::chrono::steady_clock::now())
+    , m_lines_in_window(0)
+    , m_suppressed(0)
+{
+    for (std::atomic<uint64_t>& c: m_counters) {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+void Diagnostics::flush(std::ostream& os)
+{
+    if (m_events.empty()) {
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    if (now - m_window_start >= std::chrono::seconds(1)) {
+        if (m_suppressed > 0) {
+            os << "(" << std::dec << m_suppressed << " diagnostics suppressed)" << std::endl;
+        }
+
+        m_window_start    = now;
+        m_lines_in_window = 0;
+        m_suppressed      = 0;
+    }
+
+    Event e;
+
+    while (m_events.pop(e)) {
+        if (m_lines_in_window < max_lines_per_second) {
+            os << typeName(e.type)
+               << " " << std::hex << std::setfill('0')
+               << std::setw(4) << e.opcode
+               << " at 0x" << std::setw(3) << e.address
+               << std::dec << std::setfill(' ') << std::endl;
+
+            m_lines_in_window++;
+        } else {
+            m_suppressed++;
+        }
+    }
+}
+
+
+void Diagnostics::summary(std::ostream& os) const
+{
+    for (int t = 0; t < TYPE_COUNT; t++) {
+        const uint64_t c = count((Type)t);
+
+        if (c > 0) {
+            os << typeName((Type)t) << ": " << std::dec << c << " times" << std::endl;
+        }
+    }
+
+    const uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+
+    if (dropped > 0) {
+        os << dropped << " diagnostics were dropped" << std::endl;
+    }
+}
+
+
+const char* Diagnostics::typeName(Type type)
+{
+    switch (type) {
+        case UNKNOWN_OPCODE:  return "Unknown opcode";
+        case NATIVE_CALL:     return "Native call";
+        case STACK_OVERFLOW:  return "Stack overflow";
+        case STACK_UNDERFLOW: return "Return without call";
+        case OUT_OF_BOUNDS:   return "Access past 4 KiB";
+        default:              return "?";
+    }
+}
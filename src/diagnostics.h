@@ -0,0 +1,84 @@
+#pragma once
+
+#include <spsc_queue.h>
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Channel for the problems met by the interpreter while running a program.
+//
+// The interpreter reports events without ever blocking or doing I/O: each
+// event type has a counter and only the first occurrence of an event at a
+// given address is queued. The frontend prints the queued events with flush()
+// at a limited rate.
+class Diagnostics
+{
+public:
+    enum Type {
+        UNKNOWN_OPCODE,
+        NATIVE_CALL,
+        STACK_OVERFLOW,
+        STACK_UNDERFLOW,
+        OUT_OF_BOUNDS,
+        TYPE_COUNT
+    };
+
+    struct Event {
+        Type     type;
+        uint16_t address;
+        uint16_t opcode;
+    };
+
+    Diagnostics();
+
+    // Interpreter side
+    void report(Type type, uint16_t address, uint16_t opcode)
+    {
+        m_counters[type].fetch_add(1, std::memory_order_relaxed);
+
+        if (m_seen[type].test(address)) {
+            return;
+        }
+
+        m_seen[type].set(address);
+
+        if (!m_events.push({type, address, opcode})) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Number of times an event of the given type was reported
+    uint64_t count(Type type) const
+    {
+        return m_counters[type].load(std::memory_order_relaxed);
+    }
+
+    // Frontend side: print the pending events, no more than
+    // max_lines_per_second lines are written
+    void flush(std::ostream& os);
+
+    // Print the counters of all the event types which occurred
+    void summary(std::ostream& os) const;
+
+    static const char* typeName(Type type);
+
+protected:
+    SpscQueue<Event, 256> m_events;
+
+    std::array<std::atomic<uint64_t>, TYPE_COUNT> m_counters;
+    std::atomic<uint64_t> m_dropped;
+
+    // Addresses for which an event was already queued
+    std::array<std::bitset<0x10000>, TYPE_COUNT> m_seen;
+
+    // Rate limiting of the output
+    static constexpr int max_lines_per_second = 10;
+
+    std::chrono::steady_clock::time_point m_window_start;
+    int m_lines_in_window;
+    uint64_t m_suppressed;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+// Shows the 1 bit per pixel screen of the computer in a window
+class Display
+{
+public:
+    virtual ~Display() {}
+
+    // Change the resolution of the screen, its content is undefined until
+    // all the rows are updated
+    virtual void resize(int width, int height) = 0;
+
+    // Update the given rows from a screen of width / 8 bytes per row. The
+    // second XO-CHIP plane is null when it is empty.
+    virtual void update(const uint8_t* screen, const uint8_t* second_plane, uint64_t dirty_rows) = 0;
+
+    // Same as above from 8 bit intensities, one byte per pixel
+    virtual void updateShades(const uint8_t* shades, uint64_t dirty_rows) = 0;
+
+    // Show the updated content in the window
+    virtual void present() = 0;
+
+protected:
+    // Call f(y_start, y_end) for each run of consecutive set bits in rows
+    template<typename F>
+    static void forEachRowRun(uint64_t rows, int height, F f)
+    {
+        int y = 0;
+
+        while (y < height) {
+            if (((rows >> y) & 1) == 0) {
+                y++;
+                continue;
+            }
+
+            int y_end = y + 1;
+
+            while (y_end < height && ((rows >> y_end) & 1)) {
+                y_end++;
+            }
+
+            f(y, y_end);
+
+            y = y_end;
+        }
+    }
+};
@@ -0,0 +1,427 @@
+#include <emulator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+
+Emulator::Emulator(
+    Computer& computer,
+    Beeper& beeper,
+    LatencyProbe* latency,
+    double speed)
+    : m_computer(computer)
+    , m_beeper(beeper)
+    , m_latency(latency)
+    , m_pacer(Computer::timer_Hz * speed)
+    , m_quit(false)
+    , m_speed(speed)
+    , m_turbo(false)
+    , m_cycles(computer.cycle())
+    , m_sequence(0)
+    , m_published_generation(computer.screenGeneration() - 1)
+    , m_audio_generation(computer.audioGeneration())
+    , m_audio_speed(0.)
+    , m_recording(nullptr)
+    , m_replay(nullptr)
+    , m_capture(nullptr)
+    , m_shared_state(nullptr)
+    , m_frame_callback(nullptr)
+    , m_frame_callback_userdata(nullptr)
+    , m_sleeping(false)
+{
+    m_frame_key_events.reserve(m_key_events.capacity());
+}
+
+
+Emulator::~Emulator()
+{
+    stop();
+}
+
+
+void Emulator::start()
+{
+    m_quit.store(false);
+    m_thread = std::thread(&Emulator::run, this);
+}
+
+
+void Emulator::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    m_quit.store(true);
+
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_wake_cond.notify_one();
+    }
+
+    m_thread.join();
+}
+
+
+void Emulator::setFrameCallback(FrameCallback callback, void* userdata)
+{
+    m_frame_callback          = callback;
+    m_frame_callback_userdata = userdata;
+}
+
+
+void Emulator::keyPress(uint8_t key, LatencyProbe::clock::time_point time)
+{
+    pushKeyEvent({key, true, time});
+}
+
+
+void Emulator::keyRelease(uint8_t key, LatencyProbe::clock::time_point time)
+{
+    pushKeyEvent({key, false, time});
+}
+
+
+void Emulator::setSpeed(double speed)
+{
+    m_speed.store(speed, std::memory_order_relaxed);
+}
+
+
+void Emulator::setTurbo(bool turbo)
+{
+    m_turbo.store(turbo, std::memory_order_relaxed);
+    wake();
+}
+
+
+void Emulator::run()
+{
+    double speed = m_speed.load(std::memory_order_relaxed);
+    bool   turbo = m_turbo.load(std::memory_order_relaxed);
+
+    m_pacer.setFrequency(Computer::timer_Hz * speed);
+    m_pacer.reset();
+
+    while (!m_quit.load(std::memory_order_relaxed)) {
+        // Speed changes requested by the frontend
+        const double new_speed = m_speed.load(std::memory_order_relaxed);
+        const bool   new_turbo = m_turbo.load(std::memory_order_relaxed);
+
+        if (new_speed != speed) {
+            speed = new_speed;
+            m_pacer.setFrequency(Computer::timer_Hz * speed);
+        }
+
+        if (new_turbo != turbo) {
+            turbo = new_turbo;
+            m_pacer.reset();
+        }
+
+        takeKeyEvents(speed, turbo);
+
+        if (m_latency) {
+            const std::chrono::duration<double> period(turbo ? 0. : 1. / (Computer::timer_Hz * speed));
+
+            m_latency->beforeFrame(
+                m_computer,
+                std::chrono::duration_cast<LatencyProbe::clock::duration>(period));
+        }
+
+        // Run the CPU for a frame
+        runFrame();
+
+        if (m_latency) {
+            m_latency->afterFrame(m_computer, m_sequence);
+        }
+
+        publishFrame();
+
+        if (m_shared_state) {
+            m_shared_state->publish(m_computer);
+        }
+
+        m_cycles.store(m_computer.cycle(), std::memory_order_relaxed);
+
+        if (!turbo) {
+            updateSound(speed);
+        }
+
+        const Computer::Idle idle = m_computer.idleState();
+
+        // The audio stream is rendered frame by frame, keep running in real
+        // time while the sound plays
+        const bool sounding = !turbo && m_computer.soundTimer() > 0;
+
+        // A replay does not sleep, the next event comes at a given cycle.
+        // Idle periods are skipped within the frames anyway.
+        const bool replaying = m_replay && !m_replay->finished();
+
+        if (idle == Computer::ACTIVE || sounding || replaying) {
+            // Wait for the start of the next frame
+            if (!turbo) {
+                m_pacer.wait();
+            }
+        } else if (turbo && idle == Computer::WAIT_DELAY) {
+            // Skip the whole wait at once
+            m_computer.fastForward(m_computer.delayExpiryCycle() - m_computer.cycle());
+        } else {
+            // No need to spin the interpreter nor to publish identical frames
+            sleepWhileIdle(idle, turbo ? 1. : speed);
+            m_pacer.reset();
+        }
+    }
+}
+
+
+void Emulator::pushKeyEvent(const KeyEvent& e)
+{
+    // The queue is large enough for any human input, an event is only lost
+    // if the emulation thread is stalled
+    m_key_events.push(e);
+    wake();
+}
+
+
+void Emulator::takeKeyEvents(double speed, bool turbo)
+{
+    const uint64_t cycles_per_frame = m_computer.cyclesPerFrame();
+    const uint64_t frame_start = m_computer.cycle();
+    const uint64_t frame_end   = (frame_start / cycles_per_frame + 1) * cycles_per_frame;
+
+    m_frame_key_events.clear();
+
+    KeyEvent e;
+
+    while (m_key_events.pop(e)) {
+        if (m_replay && !m_replay->finished()) {
+            continue;
+        }
+
+        // The first event is applied right away, the next ones as long
+        // after it as they arrived after it. In turbo the wall clock has no
+        // relation to the emulated one.
+        uint64_t offset = 0;
+
+        if (!turbo && !m_frame_key_events.empty()) {
+            const std::chrono::duration<double> delay = e.time - m_frame_key_events.front().event.time;
+
+            offset = (uint64_t)std::max(0., delay.count() * Computer::timer_Hz * speed * cycles_per_frame);
+        }
+
+        m_frame_key_events.push_back({e, std::min(frame_start + offset, frame_end - 1)});
+    }
+}
+
+
+void Emulator::applyKeyEvent(const KeyEvent& e)
+{
+    if (m_latency) {
+        m_latency->keyEvent(m_computer, e.key, e.time);
+    }
+
+    if (e.pressed) {
+        m_computer.keyPress(e.key);
+    } else {
+        m_computer.keyRelease(e.key);
+    }
+
+    if (m_recording) {
+        m_recording->record(m_computer.cycle(), e.key, e.pressed);
+    }
+}
+
+
+void Emulator::runFrame()
+{
+    const uint64_t cycles_per_frame = m_computer.cyclesPerFrame();
+    const uint64_t frame_end = (m_computer.cycle() / cycles_per_frame + 1) * cycles_per_frame;
+
+    size_t next_key = 0;
+
+    // Split the frame at each event, the computer skips the idle parts
+    while (m_computer.cycle() < frame_end) {
+        while (next_key < m_frame_key_events.size()
+            && m_frame_key_events[next_key].cycle <= m_computer.cycle()) {
+            applyKeyEvent(m_frame_key_events[next_key++].event);
+        }
+
+        uint64_t next = frame_end;
+
+        if (next_key < m_frame_key_events.size()) {
+            next = std::min(next, m_frame_key_events[next_key].cycle);
+        }
+
+        if (m_replay) {
+            m_replay->apply(m_computer);
+            next = std::min(next, m_replay->nextCycle());
+        }
+
+        m_computer.advance(next);
+    }
+}
+
+
+void Emulator::publishFrame()
+{
+    if (m_computer.screenGeneration() == m_published_generation) {
+        return;
+    }
+
+    m_published_generation = m_computer.screenGeneration();
+
+    Frame& frame = m_frames.back();
+
+    m_computer.screenBits(frame.planes[0].data());
+    frame.plane_count = m_computer.planeCount();
+
+    if (frame.plane_count == 2) {
+        m_computer.screenBits(frame.planes[1].data(), 1);
+    }
+
+    frame.width  = m_computer.width();
+    frame.height = m_computer.height();
+    frame.dirty_rows = m_computer.takeDirtyRows();
+    frame.sequence   = m_sequence++;
+
+    if (m_capture) {
+        m_capture->push(
+            m_computer.cycle() / m_computer.cyclesPerFrame(),
+            frame.planes[0].data(),
+            frame.plane_count == 2 ? frame.planes[1].data() : nullptr,
+            frame.width, frame.height);
+    }
+
+    m_frames.publish();
+
+    if (m_frame_callback) {
+        m_frame_callback(m_frame_callback_userdata);
+    }
+}
+
+
+void Emulator::updateSound(double speed)
+{
+    // XO-CHIP pattern or pitch changed, the rate follows the emulation speed
+    if (m_computer.audioGeneration() != m_audio_generation || speed != m_audio_speed) {
+        m_audio_generation = m_computer.audioGeneration();
+        m_audio_speed      = speed;
+
+        if (m_computer.hasAudioPattern()) {
+            m_beeper.setPattern(m_computer.audioPattern(), m_computer.audioPatternRate() * speed);
+        }
+    }
+
+    // The frame just run, the sound switches at the exact cycle the program
+    // started it and at the frame its timer expires
+    const uint64_t cycles_per_frame = m_computer.cyclesPerFrame();
+    const uint64_t frame_end   = m_computer.cycle();
+    const uint64_t frame_start = frame_end - cycles_per_frame;
+
+    const uint64_t on_start = std::max(m_computer.soundStartCycle(), frame_start);
+    const uint64_t on_end   = std::min(m_computer.soundExpiryCycle(), frame_end);
+
+    double on_begin = 0.;
+    double on_stop  = 0.;
+
+    if (on_start < on_end) {
+        on_begin = (double)(on_start - frame_start) / cycles_per_frame;
+        on_stop  = (double)(on_end   - frame_start) / cycles_per_frame;
+    }
+
+    m_beeper.renderFrame(1. / (Computer::timer_Hz * speed), on_begin, on_stop);
+}
+
+
+void Emulator::sleepWhileIdle(Computer::Idle idle, double speed)
+{
+    typedef std::chrono::steady_clock clock;
+
+    const uint64_t cycles_per_frame = m_computer.cyclesPerFrame();
+    const clock::time_point sleep_start = clock::now();
+
+    // Frames left before the delay timer expires
+    uint64_t max_frames = UINT64_MAX;
+    uint64_t frames_done = 0;
+
+    const bool turbo = m_turbo.load();
+
+    auto woken = [&]() {
+        return m_quit.load() || m_turbo.load() != turbo || !m_key_events.empty();
+    };
+
+    // Advance the clock by the frames elapsed since the sleep started
+    auto catch_up = [&]() {
+        const std::chrono::duration<double> elapsed = clock::now() - sleep_start;
+        const uint64_t frames = std::min((uint64_t)(speed * elapsed.count() * Computer::timer_Hz), max_frames);
+
+        m_computer.fastForward((frames - frames_done) * cycles_per_frame);
+        frames_done = frames;
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(m_wake_mutex);
+
+        m_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool timed = false;
+        clock::time_point deadline = sleep_start;
+
+        if (idle == Computer::WAIT_DELAY) {
+            max_frames = (m_computer.delayExpiryCycle() - m_computer.cycle()) / cycles_per_frame;
+
+            timed = true;
+            deadline = sleep_start + std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(max_frames / (Computer::timer_Hz * speed)));
+        }
+
+        // The exported state keeps following the clock, a program waiting
+        // for a key must not look hung
+        const clock::duration publish_period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1. / Computer::timer_Hz));
+
+        while (!woken()) {
+            if (m_shared_state) {
+                const clock::time_point next = clock::now() + publish_period;
+
+                m_wake_cond.wait_until(lock, timed ? std::min(next, deadline) : next, woken);
+            } else if (timed) {
+                m_wake_cond.wait_until(lock, deadline, woken);
+            } else {
+                m_wake_cond.wait(lock, woken);
+            }
+
+            if (woken() || (timed && clock::now() >= deadline)) {
+                break;
+            }
+
+            if (m_shared_state) {
+                catch_up();
+                m_shared_state->publish(m_computer);
+            }
+        }
+
+        m_sleeping.store(false);
+    }
+
+    catch_up();
+
+    if (m_shared_state) {
+        m_shared_state->publish(m_computer);
+    }
+}
+
+
+void Emulator::wake()
+{
+    // Pairs with the fence in sleepWhileIdle(): either the emulation thread
+    // sees the new state before sleeping, or we see it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (m_sleeping.load()) {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_wake_cond.notify_one();
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <computer.h>
+#include <beeper.h>
+#include <capture.h>
+#include <latency.h>
+#include <movie.h>
+#include <pacer.h>
+#include <shared_state.h>
+#include <spsc_queue.h>
+#include <triple_buffer.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a Computer on its own thread, paced at 60 frames per second.
+//
+// The frontend thread sends the key events through a lock-free queue and
+// takes the completed frames from a lock-free triple buffer, so a slow
+// presentation never delays the emulation. Key events are timestamped when
+// they arrive and applied within the next frame with the same spacing, so a
+// short tap is not collapsed into a press and a release at the same cycle.
+class Emulator
+{
+public:
+    // A frame completed by the emulation thread
+    struct Frame {
+        // Up to 128x64 pixels, width / 8 bytes per row, for each XO-CHIP
+        // plane. The second plane is only filled when plane_count is 2.
+        std::array<std::array<uint8_t, 1024>, 2> planes;
+        uint8_t plane_count;
+        uint8_t width;
+        uint8_t height;
+
+        // Rows changed since the previous published frame
+        uint64_t dirty_rows;
+
+        // Number of frames published before this one
+        uint64_t sequence;
+    };
+
+    // Called by the emulation thread each time a frame is published
+    typedef void (*FrameCallback)(void* userdata);
+
+    Emulator(
+        Computer& computer,
+        Beeper& beeper,
+        LatencyProbe* latency,
+        double speed);
+
+    virtual ~Emulator();
+
+    void start();
+    void stop();
+
+    void setFrameCallback(FrameCallback callback, void* userdata);
+
+    // Both are only set before start(). Key events are recorded with the
+    // cycle at which they were applied. While a movie is replayed, the keys
+    // of the frontend are ignored.
+    void setRecording(Movie* movie) { m_recording = movie; }
+    void setReplay(MoviePlayer* player) { m_replay = player; }
+
+    // Also set before start(), every published frame is captured
+    void setCapture(VideoCapture* capture) { m_capture = capture; }
+
+    // Also set before start(), the state is exported after each frame
+    void setSharedState(SharedState* shared_state) { m_shared_state = shared_state; }
+
+    // Frontend side. The time is when the event arrived, their spacing is
+    // kept in emulated time.
+    void keyPress(uint8_t key, LatencyProbe::clock::time_point time = LatencyProbe::clock::now());
+    void keyRelease(uint8_t key, LatencyProbe::clock::time_point time = LatencyProbe::clock::now());
+
+    void setSpeed(double speed);
+    double speed() const { return m_speed.load(std::memory_order_relaxed); }
+
+    void setTurbo(bool turbo);
+    bool turbo() const { return m_turbo.load(std::memory_order_relaxed); }
+
+    // Number of cycles run by the computer, updated after each frame
+    uint64_t cycles() const { return m_cycles.load(std::memory_order_relaxed); }
+
+    TripleBuffer<Frame>& frames() { return m_frames; }
+
+    // Only valid once the emulation thread is stopped
+    const Pacer& pacer() const { return m_pacer; }
+
+protected:
+    struct KeyEvent {
+        uint8_t key;
+        bool pressed;
+        LatencyProbe::clock::time_point time;
+    };
+
+    void run();
+
+    // A key event and the cycle it is applied at
+    struct TimedKeyEvent {
+        KeyEvent event;
+        uint64_t cycle;
+    };
+
+    void pushKeyEvent(const KeyEvent& e);
+
+    // Schedule the queued key events within the next frame
+    void takeKeyEvents(double speed, bool turbo);
+    void applyKeyEvent(const KeyEvent& e);
+
+    // Run up to the next frame boundary, applying the key events at their
+    // cycle
+    void runFrame();
+
+    // Publish the screen if it changed since the last published frame
+    void publishFrame();
+    void updateSound(double speed);
+
+    // Sleep while the program idles, until the event it waits for happens or
+    // a key event is received. The clock of the computer is then advanced by
+    // the time spent sleeping.
+    void sleepWhileIdle(Computer::Idle idle, double speed);
+
+    // Wake the emulation thread if it sleeps
+    void wake();
+
+protected:
+    Computer& m_computer;
+    Beeper& m_beeper;
+    LatencyProbe* m_latency;
+
+    Pacer m_pacer;
+
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+
+    std::atomic<double> m_speed;
+    std::atomic<bool> m_turbo;
+    std::atomic<uint64_t> m_cycles;
+
+    SpscQueue<KeyEvent, 256> m_key_events;
+    std::vector<TimedKeyEvent> m_frame_key_events;
+
+    TripleBuffer<Frame> m_frames;
+    uint64_t m_sequence;
+
+    // Frames are only published when the screen changed
+    uint64_t m_published_generation;
+
+    // Last XO-CHIP pattern handed to the beeper
+    uint64_t m_audio_generation;
+    double m_audio_speed;
+
+    Movie* m_recording;
+    MoviePlayer* m_replay;
+    VideoCapture* m_capture;
+    SharedState* m_shared_state;
+
+    FrameCallback m_frame_callback;
+    void* m_frame_callback_userdata;
+
+    // Only used to sleep while the program idles
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake_cond;
+    std::atomic<bool> m_sleeping;
+};
@@ -0,0 +1,169 @@
+#include <latency.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+
+LatencyProbe::LatencyProbe()
+    : m_frame_cycle(0)
+    , m_frame_period(0)
+{
+}
+
+
+void LatencyProbe::keyEvent(const Computer& computer, uint8_t key, clock::time_point t_event)
+{
+    Sample s;
+    s.stage     = WAIT_READ;
+    s.key       = key;
+    s.key_reads = computer.keyReads(key);
+    s.t_event   = t_event;
+    s.screen    = computer.screen();
+    s.sequence  = 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.push_back(s);
+}
+
+
+void LatencyProbe::beforeFrame(const Computer& computer, clock::duration period)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_frame_start  = clock::now();
+    m_frame_cycle  = computer.cycle();
+    m_frame_period = period;
+}
+
+
+void LatencyProbe::afterFrame(const Computer& computer, uint64_t sequence)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_pending.empty()) {
+        return;
+    }
+
+    const clock::time_point now = clock::now();
+
+    const clock::duration period =
+        (m_frame_period == clock::duration::zero()) ? now - m_frame_start : m_frame_period;
+
+    for (Sample& s: m_pending) {
+        if (s.stage == WAIT_READ) {
+            if (computer.keyReads(s.key) != s.key_reads) {
+                // Its first read since the key changed is in this frame,
+                // unless the key changed again since the event
+                const uint64_t read_cycle = std::max(computer.keyReadCycle(s.key), m_frame_cycle);
+                const double frame_fraction =
+                    (double)(std::min(read_cycle, computer.cycle()) - m_frame_cycle) / computer.cyclesPerFrame();
+
+                const clock::time_point t_read =
+                    m_frame_start + std::chrono::duration_cast<clock::duration>(period * frame_fraction);
+
+                m_read_ms.push_back(elapsedMs(s.t_event, t_read));
+                s.stage = WAIT_SCREEN;
+            } else {
+                // The screen at the start of the frame in which the key is
+                // read is the reference for detecting a change
+                s.screen = computer.screen();
+            }
+        }
+
+        // The reaction may be drawn in the same frame as the key read
+        if (s.stage == WAIT_SCREEN) {
+            if (computer.screen() != s.screen) {
+                m_screen_ms.push_back(elapsedMs(s.t_event, now));
+                s.stage    = WAIT_PRESENT;
+                s.sequence = sequence;
+            }
+        }
+    }
+
+    // Forget about the events the program did not react to
+    m_pending.erase(
+        std::remove_if(
+            m_pending.begin(), m_pending.end(),
+            [&](const Sample& s) {
+                return s.stage != WAIT_PRESENT
+                    && elapsedMs(s.t_event, now) > timeout_ms;
+            }),
+        m_pending.end()
+    );
+}
+
+
+void LatencyProbe::afterPresent(uint64_t sequence)
+{
+    const clock::time_point now = clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_pending.empty()) {
+        return;
+    }
+
+    // The presented frame holds the changes made up to its sequence number
+    auto presented = [&](const Sample& s) {
+        return s.stage == WAIT_PRESENT && s.sequence <= sequence;
+    };
+
+    for (const Sample& s: m_pending) {
+        if (presented(s)) {
+            m_present_ms.push_back(elapsedMs(s.t_event, now));
+        }
+    }
+
+    m_pending.erase(
+        std::remove_if(m_pending.begin(), m_pending.end(), presented),
+        m_pending.end()
+    );
+}
+
+
+void LatencyProbe::report(std::ostream& os) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    os << "Input latency (ms)" << std::endl;
+    printStage(os, "key -> read   ", m_read_ms);
+    printStage(os, "key -> screen ", m_screen_ms);
+    printStage(os, "key -> present", m_present_ms);
+}
+
+
+double LatencyProbe::elapsedMs(clock::time_point from, clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+
+void LatencyProbe::printStage(
+    std::ostream& os,
+    const char* name,
+    std::vector<double> latencies_ms)
+{
+    os << "  " << name << ": ";
+
+    if (latencies_ms.empty()) {
+        os << "no sample" << std::endl;
+        return;
+    }
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+
+    // Nearest rank percentile
+    auto percentile = [&](double p) {
+        const size_t rank = (size_t)std::ceil(p / 100. * latencies_ms.size());
+        return latencies_ms[std::max(rank, (size_t)1) - 1];
+    };
+
+    os << std::fixed << std::setprecision(2)
+       << "n=" << latencies_ms.size()
+       << " p50=" << percentile(50.)
+       << " p90=" << percentile(90.)
+       << " p99=" << percentile(99.)
+       << " max=" << latencies_ms.back()
+       << std::endl;
+}
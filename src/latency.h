@@ -0,0 +1,91 @@
+#pragma once
+
+#include <computer.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Measures the input-to-photon latency of the emulator.
+//
+// Each key event is timestamped when the frontend receives it. The probe then
+// records when the program first observes that key (EX9E, EXA1 or FX0A), when
+// the screen first changes after that, and when the frame holding the change
+// has been presented.
+//
+// The read is dated from its cycle, placed within the wall clock span of its
+// frame. The screen change is only known at the end of the frame.
+//
+// The emulation thread calls keyEvent(), beforeFrame() and afterFrame(), the
+// render thread calls afterPresent().
+class LatencyProbe
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    LatencyProbe();
+
+    // A key event received from the host at time t_event is given to the
+    // computer
+    void keyEvent(const Computer& computer, uint8_t key, clock::time_point t_event);
+
+    // Must be called before each Computer::runFrame(). A frame lasts period
+    // on the wall clock at the current speed, a zero period stands for the
+    // time it actually takes to run, as in turbo.
+    void beforeFrame(const Computer& computer, clock::duration period);
+
+    // Must be called after each Computer::runFrame(), with the sequence
+    // number of the frame about to be published
+    void afterFrame(const Computer& computer, uint64_t sequence);
+
+    // Must be called once SDL_RenderPresent() has returned for the frame with
+    // the given sequence number
+    void afterPresent(uint64_t sequence);
+
+    // Print the latency percentiles of every stage
+    void report(std::ostream& os) const;
+
+protected:
+
+    enum Stage {
+        WAIT_READ,
+        WAIT_SCREEN,
+        WAIT_PRESENT
+    };
+
+    struct Sample {
+        Stage stage;
+        uint8_t key;
+        uint32_t key_reads;
+        clock::time_point t_event;
+        std::vector<uint64_t> screen;
+        uint64_t sequence;
+    };
+
+    static double elapsedMs(clock::time_point from, clock::time_point to);
+
+    static void printStage(
+        std::ostream& os,
+        const char* name,
+        std::vector<double> latencies_ms);
+
+protected:
+    mutable std::mutex m_mutex;
+
+    std::vector<Sample> m_pending;
+
+    // Wall clock time and cycle at the start of the current frame
+    clock::time_point m_frame_start;
+    uint64_t m_frame_cycle;
+    clock::duration m_frame_period;
+
+    std::vector<double> m_read_ms;
+    std::vector<double> m_screen_ms;
+    std::vector<double> m_present_ms;
+
+    // Key events never observed by the program or not followed by a screen
+    // change are dropped after this delay
+    static constexpr double timeout_ms = 1000.;
+};
@@ -2,51 +2,38 @@
 #include <cstdio>
 #include <cstdint>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <array>
+#include <iomanip>
 
 #include <computer.h>
 #include <beeper.h>
+#include <capture.h>
+#include <software_display.h>
+#include <texture_display.h>
+#include <emulator.h>
+#include <latency.h>
+#include <movie.h>
+#include <options.h>
+#include <mapped_file.h>
+#include <phosphor.h>
+#include <quirk_detector.h>
+#include <rom_database.h>
+#include <shared_state.h>
 
 #include <SDL.h>
-#include <cassert>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
 
 // Tests
 // - https://github.com/Skosulor/c8int/tree/master/test
 // - https://github.com/corax89/chip8-test-rom
 
-// Converts 1 bit per pixel screen data to RGBA
-void screen_to_sdl(
-    const std::vector<uint8_t>& screen,
-    int width, int height,
-    std::vector<uint8_t>& sdl_screen,
-    int width_sdl, int height_sdl)
-{
-
-    assert(screen.size() == (width / 8) * height);
-    assert(sdl_screen.size() == 4 * width_sdl * height_sdl);
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width / 8; x++) {
-            const int x_sdl = 8 * x;
-
-            // Get 8 px at a time
-            uint8_t c = screen[y * width / 8 + x];
-
-            uint8_t offset = 0b10000000;
-
-            for (int i = 0; i < 8; i++) {
-                sdl_screen[4 * (y * width_sdl + (8 * x + i)) + 0] = (c & offset) ? 0xFF: 0x00;
-                sdl_screen[4 * (y * width_sdl + (8 * x + i)) + 1] = (c & offset) ? 0xFF: 0x00;
-                sdl_screen[4 * (y * width_sdl + (8 * x + i)) + 2] = (c & offset) ? 0xFF: 0x00;
-                sdl_screen[4 * (y * width_sdl + (8 * x + i)) + 3] = 0xFF;
-
-                offset = offset >> 1;
-            }
-        }
-    }
-}
-
-
 // Create key bindings
 // ╔═══╦═══╦═══╦═══╗
 // ║ 1 ║ 2 ║ 3 ║ C ║
@@ -88,46 +75,322 @@ uint8_t keyBinding(SDL_Scancode code)
 }
 
 
+// Hand the current screen to the capture, from the current frame on
+void capture_screen(const Computer& computer, VideoCapture& capture)
+{
+    std::array<uint8_t, 1024> first;
+    std::array<uint8_t, 1024> second;
+
+    computer.screenBits(first.data(), 0);
+
+    if (computer.planeCount() == 2) {
+        computer.screenBits(second.data(), 1);
+    }
+
+    capture.push(
+        computer.cycle() / computer.cyclesPerFrame(),
+        first.data(),
+        computer.planeCount() == 2 ? second.data() : nullptr,
+        computer.width(), computer.height());
+}
+
+
+void report_capture(const VideoCapture& capture, std::ostream& os)
+{
+    os << "Captured " << capture.framesWritten() << " frames" << std::endl;
+
+    if (capture.changesSkipped() > 0) {
+        os << capture.changesSkipped() << " intermediate screens were skipped, the disk is too slow" << std::endl;
+    }
+}
+
+
+// Replay a movie without window nor sound as fast as possible, the idle
+// periods are skipped. Reports the throughput and a hash of the final screen
+// to compare builds on the same input.
+int run_headless(Computer& computer, const Movie& movie, VideoCapture* capture, std::ostream& info)
+{
+    MoviePlayer player(movie);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t executed = 0;
+    uint64_t captured_generation = computer.screenGeneration() - 1;
+
+    // Split the run at the same cycles as the emulation thread did
+    while (computer.cycle() < movie.endCycle()) {
+        player.apply(computer);
+
+        const uint64_t frame_end = (computer.cycle() / movie.cyclesPerFrame() + 1) * movie.cyclesPerFrame();
+
+        executed += computer.advance(std::min(std::min(player.nextCycle(), frame_end), movie.endCycle()));
+
+        // Same frames as the emulation thread would publish
+        if (capture
+         && computer.cycle() == frame_end
+         && computer.screenGeneration() != captured_generation) {
+            captured_generation = computer.screenGeneration();
+            capture_screen(computer, *capture);
+        }
+    }
+
+    if (capture) {
+        capture->finish(movie.endCycle() / movie.cyclesPerFrame());
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<uint8_t> screen(2 * 1024);
+    computer.screenBits(screen.data(), 0);
+    computer.screenBits(screen.data() + 1024, 1);
+
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a_hash(screen));
+
+    info << "Replayed " << movie.events().size() << " events over "
+              << movie.endCycle() / ((double)movie.cyclesPerFrame() * Computer::timer_Hz) << " s" << std::endl
+              << "Executed " << executed << " instructions in " << elapsed.count() << " s ("
+              << executed / elapsed.count() * 1e-6 << " MIPS)" << std::endl
+              << "Screen hash: " << hash << std::endl;
+
+    return 0;
+}
+
+
+// Run the ROM for 10 emulated seconds, or the movie, under every quirk
+// combination and report which ones look right. Returns the recommended
+// quirks.
+Quirks detect_quirks(const std::vector<uint8_t>& rom, const Options& options, const Movie* script, std::ostream& info)
+{
+    QuirkDetector detector(rom, options.cycles_per_frame, options.seed, script);
+
+    const std::vector<QuirkDetector::Result> results = detector.run(10 * Computer::timer_Hz);
+
+    info << std::left
+         << std::setw(18) << "Quirks"
+         << std::setw(10) << "Unknown"
+         << std::setw(10) << "Stack"
+         << std::setw(10) << "Past 4K"
+         << "Screens" << std::endl;
+
+    for (const QuirkDetector::Result& r : results) {
+        info << std::setw(18) << r.quirks.name()
+             << std::setw(10) << r.unknown_opcodes
+             << std::setw(10) << r.stack_faults
+             << std::setw(10) << r.out_of_bounds
+             << r.screen_changes << std::endl;
+    }
+
+    info << std::right;
+
+    const QuirkDetector::Result& best = results.front();
+
+    if (best.faultKinds() > 0) {
+        info << "Every profile faults, the ROM may need another interpreter" << std::endl;
+    }
+
+    // Runs as clean as the best one which end up drawing something else
+    for (size_t i = 1; i < results.size(); i++) {
+        const QuirkDetector::Result& r = results[i];
+
+        if (r.faultKinds() != best.faultKinds() || r.faults() != best.faults()) {
+            break;
+        }
+
+        const uint64_t frame = QuirkDetector::firstDivergence(best, r);
+
+        if (frame != UINT64_MAX) {
+            info << "--quirks " << r.quirks.name() << " is as plausible but draws differently from frame "
+                 << frame << ", compare both" << std::endl;
+        }
+    }
+
+    info << "Recommended: --quirks " << best.quirks.name() << std::endl;
+
+    return best.quirks;
+}
+
+
+// When SDL received an event, on the clock of the key events. The event loop
+// handles it up to a refresh later when it was blocked in a vsync present.
+LatencyProbe::clock::time_point event_time(Uint32 timestamp)
+{
+    const LatencyProbe::clock::time_point now = LatencyProbe::clock::now();
+    const Uint32 age_ms = SDL_GetTicks() - timestamp;
+
+    // Millisecond resolution, a bogus timestamp falls back to now
+    return (age_ms < 1000) ? now - std::chrono::milliseconds(age_ms) : now;
+}
+
+
+// Show the emulation speed and throughput in the window title
+void update_title(SDL_Window* window, double speed, double mips, bool turbo)
+{
+    char title[64];
+
+    std::snprintf(
+        title, sizeof(title),
+        "CHIP8 - %s%.2fx - %.2f MIPS",
+        turbo ? "turbo " : "", speed, mips);
+
+    SDL_SetWindowTitle(window, title);
+}
+
+
 int main(int argc, char* argv[])
 {
-    const uint32_t proc_speed_Hz = 300;
-    const uint32_t tick_length_ms = (uint32_t)(1.f/(float)proc_speed_Hz * 1000.f);
+    Options options;
 
-    if (argc < 2) {
-        std::cout << "Usage:" << std::endl
-                  << "------" << std::endl
-                  << argv[0] << " <chip8_rom>" << std::endl;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(std::cout, argv[0]);
         return 0;
     }
 
-    const char* filename = argv[1];
+    // Keep the standard output clean when the video goes there
+    std::ostream& info = (options.capture_path == "-") ? std::cerr : std::cout;
 
-    std::FILE *f_rom = std::fopen(filename, "rb");
+    std::vector<uint8_t> rom;
 
-    if (!f_rom) {
+    try {
+        const MappedFile rom_file(options.rom_path);
+        rom.assign(rom_file.data(), rom_file.data() + rom_file.size());
+    } catch (const std::runtime_error&) {
         std::cerr << "Could not open ROM file" << std::endl;
         return -1;
     }
 
-    // Retrieve file size
-    std::fseek(f_rom, 0L, SEEK_END);
-    long int rom_size = std::ftell(f_rom);
-    std::rewind(f_rom);
+    const uint64_t rom_hash = fnv1a_hash(rom);
 
-    // Allocate enough memory to store the rom
-    std::vector<uint8_t> rom(rom_size);
+    if (options.rom_db_path.empty() && std::getenv("YACHE_ROM_DB")) {
+        options.rom_db_path = std::getenv("YACHE_ROM_DB");
+    }
+
+    if (options.rom_db_save && options.rom_db_path.empty()) {
+        std::cerr << "--rom-db-save needs a --rom-db file" << std::endl;
+        return -1;
+    }
+
+    // A known ROM starts with its settings, the command line still has the
+    // last word
+    if (!options.rom_db_path.empty()) {
+        try {
+            const RomDatabase database(options.rom_db_path);
+            RomDatabase::Entry entry;
+
+            if (database.find(rom_hash, entry)) {
+                Options configured;
+
+                configured.rom_db_path      = options.rom_db_path;
+                configured.cycles_per_frame = entry.cycles_per_frame;
+                configured.quirks           = entry.quirks;
+                configured.foreground       = entry.foreground;
+                configured.background       = entry.background;
+                configured.foreground2      = entry.foreground2;
+                configured.blend            = entry.blend;
+
+                parse_options(argc, argv, configured);
+                options = configured;
+
+                info << "Settings from " << options.rom_db_path << std::endl;
+            }
+        } catch (const std::runtime_error& e) {
+            // Saving creates the file
+            if (!options.rom_db_save) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
 
-    // Read rom content
-    std::fread(rom.data(), rom_size, 1, f_rom);
-    std::fclose(f_rom);
+    // A replay starts the computer as it was when recording
+    Movie replay;
+
+    if (!options.replay_path.empty()) {
+        try {
+            replay = Movie::load(options.replay_path);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+
+        if (replay.romHash() != rom_hash) {
+            std::cerr << "The movie was recorded with another ROM" << std::endl;
+            return -1;
+        }
+
+        options.seed             = replay.seed();
+        options.seed_set         = true;
+        options.cycles_per_frame = replay.cyclesPerFrame();
+        options.quirks           = replay.quirks();
+    }
+
+    // A run can be reproduced from the seed printed here
+    if (!options.seed_set) {
+        std::random_device device;
+        options.seed = (uint64_t)device() << 32 | device();
+    }
+
+    info << "Seed: " << options.seed << std::endl;
+
+    if (options.detect_quirks) {
+        options.quirks = detect_quirks(rom, options, options.replay_path.empty() ? nullptr : &replay, info);
+
+        if (!options.rom_db_save) {
+            return 0;
+        }
+    }
+
+    if (options.rom_db_save) {
+        const RomDatabase::Entry entry = {
+            rom_hash, options.cycles_per_frame, options.quirks,
+            options.foreground, options.background, options.foreground2, options.blend
+        };
+
+        try {
+            RomDatabase::store(options.rom_db_path, entry);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+
+        info << "Saved the settings of " << options.rom_path << " to " << options.rom_db_path << std::endl;
+
+        return 0;
+    }
 
     // Initialize the CHIP-8 computer
-    Computer computer(rom);
+    Computer computer(rom, options.cycles_per_frame, options.seed, options.quirks);
+
+    const Palette palette = {
+        options.background, options.foreground, options.foreground2, options.blend
+    };
+
+    std::unique_ptr<VideoCapture> capture;
+
+    if (!options.capture_path.empty()) {
+        try {
+            capture.reset(new VideoCapture(options.capture_path, options.capture_format, palette));
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+
+        // The first frame shows the screen as it is at power on
+        capture_screen(computer, *capture);
+    }
+
+    if (options.headless) {
+        const int ret = run_headless(computer, replay, capture.get(), info);
+
+        if (capture) {
+            report_capture(*capture, info);
+        }
+
+        return ret;
+    }
+
+    Movie recording(options.seed, options.cycles_per_frame, rom_hash, options.quirks);
 
     // Start SDL
-    SDL_Renderer* renderer;
-    SDL_Window*   window;
-    SDL_Texture*  texture;
+    SDL_Window* window;
 
     SDL_Event event;
     bool quit = false;
@@ -156,57 +419,163 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    renderer = SDL_CreateRenderer(
-        window, -1,
-        SDL_RENDERER_ACCELERATED
-    );
+    std::unique_ptr<Display> display;
 
-    if (!renderer) {
-        std::cerr << "Failed to create a renderer: "
-                  << SDL_GetError() << std::endl;
+    try {
+        if (options.software) {
+            display.reset(new SoftwareDisplay(
+                window,
+                screen_w, screen_h,
+                palette));
+        } else {
+            display.reset(new TextureDisplay(
+                window,
+                screen_w, screen_h,
+                palette));
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to create the display: "
+                  << e.what() << std::endl;
         SDL_Quit();
         return -1;
     }
 
-    texture = SDL_CreateTexture(
-        renderer,
-        SDL_PIXELFORMAT_RGBA32,
-        SDL_TEXTUREACCESS_TARGET,
-        screen_w, screen_h
-    );
+    Beeper beeper(550.f, options.audio_buffer);
 
-    if (!texture) {
-        std::cerr << "Failed to create a texture: "
-                  << SDL_GetError() << std::endl;
-        SDL_Quit();
-        return -1;
+    LatencyProbe latency;
+
+    Emulator emulator(
+        computer, beeper,
+        options.measure_latency ? &latency : nullptr,
+        options.speed);
+
+    // The emulation thread wakes us up with this event when it publishes a
+    // frame. Only one such event is in the queue at any time.
+    const Uint32 frame_event_type = SDL_RegisterEvents(1);
+    std::atomic<bool> frame_event_pending(false);
+
+    struct FrameNotifier {
+        Uint32 type;
+        std::atomic<bool>* pending;
+    } frame_notifier = {frame_event_type, &frame_event_pending};
+
+    emulator.setFrameCallback(
+        [](void* userdata) {
+            FrameNotifier* n = (FrameNotifier*)userdata;
+
+            if (!n->pending->exchange(true)) {
+                SDL_Event e;
+                SDL_zero(e);
+                e.type = n->type;
+                SDL_PushEvent(&e);
+            }
+        },
+        &frame_notifier);
+
+    MoviePlayer player(replay);
+
+    if (!options.replay_path.empty()) {
+        emulator.setReplay(&player);
     }
 
-    std::vector<uint8_t> screen_texture(screen_w * screen_h * 4);
+    if (!options.record_path.empty()) {
+        emulator.setRecording(&recording);
+    }
+
+    emulator.setCapture(capture.get());
 
-    Beeper beeper(550., 0.);
+    std::unique_ptr<SharedState> shared_state;
+
+    if (!options.shm_name.empty()) {
+        try {
+            shared_state.reset(new SharedState(options.shm_name));
+            emulator.setSharedState(shared_state.get());
+            info << "Exporting the state to " << shared_state->name() << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    const uint64_t counter_freq = SDL_GetPerformanceFrequency();
+
+    // Throughput measurement, refreshed twice per second
+    uint64_t stats_start = SDL_GetPerformanceCounter();
+    uint64_t stats_cycle = emulator.cycles();
+
+    // Sequence number of the last frame uploaded to the texture
+    uint64_t presented_sequence = UINT64_MAX;
+
+    // The window content has to be presented again
+    bool present = false;
+
+    // Optional phosphor persistence, stepped at least once per 60 Hz frame
+    // while pixels fade
+    std::unique_ptr<PhosphorFilter> phosphor;
+    uint64_t phosphor_time = SDL_GetPerformanceCounter();
+
+    if (options.phosphor) {
+        phosphor.reset(new PhosphorFilter(screen_w, screen_h));
+    }
+
+    emulator.start();
 
     while (!quit) {
-        // We keep track of the length of the execution loop
-        const uint64_t ticks_start = SDL_GetTicks64();
+        // Block until an input event, a new frame or the next statistics
+        // refresh: a ROM that never draws sends no frame event, but the
+        // title and diagnostics must keep updating
+        const uint64_t stats_elapsed_ms = (SDL_GetPerformanceCounter() - stats_start) * 1000 / counter_freq;
+        int timeout_ms = stats_elapsed_ms < 500 ? (int)(500 - stats_elapsed_ms) : 0;
+
+        if (phosphor && phosphor->fading()) {
+            const uint64_t elapsed_ms = (SDL_GetPerformanceCounter() - phosphor_time) * 1000 / counter_freq;
+            timeout_ms = std::min(timeout_ms, elapsed_ms < 16 ? (int)(16 - elapsed_ms) : 0);
+        }
+
+        const bool has_event = SDL_WaitEventTimeout(&event, timeout_ms);
+
+        for (bool more = has_event; more; more = SDL_PollEvent(&event)) {
+            if (event.type == frame_event_type) {
+                frame_event_pending.store(false);
+                continue;
+            }
 
-        while (SDL_PollEvent(&event)) {
             switch (event.type)
             {
                 case SDL_QUIT:
                     quit = true;
                     break;
+                case SDL_WINDOWEVENT:
+                    if (event.window.event == SDL_WINDOWEVENT_EXPOSED
+                     || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                        present = true;
+                    }
+                    break;
                 case SDL_KEYDOWN: {
+                    // Speed hotkeys
+                    if (event.key.keysym.scancode == SDL_SCANCODE_TAB && !event.key.repeat) {
+                        emulator.setTurbo(!emulator.turbo());
+                        break;
+                    } else if (event.key.keysym.scancode == SDL_SCANCODE_F1) {
+                        emulator.setSpeed(std::max(emulator.speed() / 2., Options::min_speed));
+                        break;
+                    } else if (event.key.keysym.scancode == SDL_SCANCODE_F2) {
+                        emulator.setSpeed(std::min(emulator.speed() * 2., Options::max_speed));
+                        break;
+                    } else if (event.key.keysym.scancode == SDL_SCANCODE_F3) {
+                        emulator.setSpeed(1.);
+                        break;
+                    }
+
                     uint8_t key_down = keyBinding(event.key.keysym.scancode);
                     if (key_down != 255) {
-                        computer.keyPress(key_down);
+                        emulator.keyPress(key_down, event_time(event.key.timestamp));
                     }
                     break;
                 }
                 case SDL_KEYUP: {
                     uint8_t key_up = keyBinding(event.key.keysym.scancode);
                     if (key_up != 255) {
-                        computer.keyRelease(key_up);
+                        emulator.keyRelease(key_up, event_time(event.key.timestamp));
                     }
                     break;
                 }
@@ -215,58 +584,135 @@ int main(int argc, char* argv[])
             }
         }
 
-        // CPU cycle
-        computer.tick();
-
-        // Convert the 1bit screen to RGBA
-        screen_to_sdl(
-            computer.screen(),
-            screen_w, screen_h,
-            screen_texture,
-            screen_w, screen_h
-        );
-
-        SDL_UpdateTexture(
-            texture, NULL,
-            screen_texture.data(),
-            screen_w * sizeof(uint32_t)
-        );
-
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
-
-        // Sound management
-        int beep_cycles_length = computer.soundTimer();
-        float beep_duration_sec = (beep_cycles_length * tick_length_ms) / 1000.;
-
-        // As noted in the COSMAC VIP manual, the minimum value that the timer
-        // will respond to is 0x02. [4] Thus, setting the timer to a value of
-        // 0x01 will have no audible effect.
-        if (beep_cycles_length >= 0x02) {
-            beep_duration_sec = std::max(beep_duration_sec, beeper.minDuration());
-            // FIXME: This mitigate popping but this is not optimal:
-            // The beeper class shall handle such case to dynamically change the
-            // amplitude max & sustain
-            if (beep_duration_sec > beeper.durationLeft()) {
-                beeper.setDurationLeft(beep_duration_sec);
+        // Present the most recent frame, with vsync this naturally limits the
+        // presentation to the display refresh rate. Frames are only
+        // published when the screen changed.
+        if (emulator.frames().update()) {
+            const Emulator::Frame& frame = emulator.frames().front();
+
+            // SUPER-CHIP programs switch between 64x32 and 128x64
+            const bool resized = (frame.width != screen_w || frame.height != screen_h);
+
+            if (resized) {
+                screen_w = frame.width;
+                screen_h = frame.height;
+
+                try {
+                    display->resize(screen_w, screen_h);
+                } catch (const std::runtime_error& e) {
+                    std::cerr << "Failed to resize the display: "
+                              << e.what() << std::endl;
+                    break;
+                }
+
+                if (phosphor) {
+                    phosphor.reset(new PhosphorFilter(screen_w, screen_h));
+                }
             }
+
+            // The dirty rows are relative to the previous frame, if we
+            // missed frames everything has to be updated
+            const uint64_t dirty_rows =
+                (frame.sequence == presented_sequence + 1 && !resized) ? frame.dirty_rows : ~(uint64_t)0;
+
+            if (!phosphor) {
+                display->update(
+                    frame.planes[0].data(),
+                    frame.plane_count == 2 ? frame.planes[1].data() : nullptr,
+                    dirty_rows);
+            }
+
+            presented_sequence = frame.sequence;
+            present = true;
         }
 
-        // Delay the execution and offset the delay to (mostly) account for 
-        // the interpreter overhead. This could be slighty improved.
-        const uint64_t ticks_now = SDL_GetTicks64();
+        if (phosphor
+         && presented_sequence != UINT64_MAX
+         && (present || phosphor->fading())) {
+            const uint64_t now = SDL_GetPerformanceCounter();
 
-        // We have to be carefull here, we are dealing with unsigned values!
-        if ((ticks_now - ticks_start) > tick_length_ms) {
-            // We do not wait, uncomment to visualise the cycle exceeding real time performance
-            // std::cerr << "Cycle was not performed in real time!" << std::endl;
-        } else {
-            SDL_Delay(tick_length_ms - (ticks_now - ticks_start));
+            // Pixels switched off after a still period start to fade now
+            const double dt = phosphor->fading() ? (double)(now - phosphor_time) / counter_freq : 0.;
+
+            // Pixels are lit when set in any XO-CHIP plane
+            const Emulator::Frame& frame = emulator.frames().front();
+            std::array<uint8_t, 1024> lit = frame.planes[0];
+
+            if (frame.plane_count == 2) {
+                for (size_t i = 0; i < lit.size(); i++) {
+                    lit[i] |= frame.planes[1][i];
+                }
+            }
+
+            const uint64_t changed_rows = phosphor->update(lit.data(), dt);
+
+            phosphor_time = now;
+
+            if (changed_rows) {
+                display->updateShades(phosphor->intensities(), changed_rows);
+                present = true;
+            }
+        }
+
+        if (present) {
+            display->present();
+
+            if (options.measure_latency) {
+                latency.afterPresent(presented_sequence);
+            }
+
+            present = false;
+        }
+
+        computer.diagnostics().flush(std::cerr);
+
+        const uint64_t now = SDL_GetPerformanceCounter();
+
+        if (now - stats_start >= counter_freq / 2) {
+            const double elapsed_s = (double)(now - stats_start) / counter_freq;
+            const double cycles    = (double)(emulator.cycles() - stats_cycle);
+
+            update_title(
+                window,
+                cycles / (elapsed_s * options.cycles_per_frame * Computer::timer_Hz),
+                cycles / elapsed_s * 1e-6,
+                emulator.turbo());
+
+            stats_start = now;
+            stats_cycle = emulator.cycles();
         }
     }
 
-    SDL_DestroyTexture(texture);
+    emulator.stop();
+
+    if (!options.record_path.empty()) {
+        recording.setEndCycle(computer.cycle());
+
+        try {
+            recording.save(options.record_path);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    if (capture) {
+        capture->finish(computer.cycle() / options.cycles_per_frame);
+        report_capture(*capture, info);
+    }
+
+    display.reset();
     SDL_Quit();
 
+    computer.diagnostics().flush(std::cerr);
+    computer.diagnostics().summary(std::cerr);
+
+    if (options.measure_latency) {
+        latency.report(std::cout);
+    }
+
+    if (options.pacing_stats) {
+        emulator.pacer().report(std::cout);
+    }
+
     return 0;
 }
\ No newline at end of file
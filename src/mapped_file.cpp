@@ -0,0 +1,77 @@
+#include <mapped_file.h>
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const std::string& path)
+    : m_data(nullptr)
+    , m_size(0)
+    , m_mapped(false)
+{
+    #ifndef _WIN32
+    const int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        m_size = (size_t)st.st_size;
+
+        // Mapping an empty file fails, there is nothing to read anyway
+        if (m_size == 0) {
+            close(fd);
+            return;
+        }
+
+        void* memory = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (memory != MAP_FAILED) {
+            close(fd);
+            m_data   = (const uint8_t*)memory;
+            m_mapped = true;
+            return;
+        }
+    }
+
+    close(fd);
+    #endif
+
+    // Pipes and platforms without mmap
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f(std::fopen(path.c_str(), "rb"), std::fclose);
+
+    if (!f) {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    uint8_t buffer[4096];
+    size_t n;
+
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f.get())) > 0) {
+        m_buffer.insert(m_buffer.end(), buffer, buffer + n);
+    }
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+
+MappedFile::~MappedFile()
+{
+    #ifndef _WIN32
+    if (m_mapped) {
+        munmap((void*)m_data, m_size);
+    }
+    #endif
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read only view of a whole file. The file is memory mapped where the
+// platform allows it, read in memory otherwise.
+class MappedFile
+{
+public:
+    // Throws a std::runtime_error if the file cannot be opened
+    MappedFile(const std::string& path);
+
+    virtual ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+protected:
+    const uint8_t* m_data;
+    size_t m_size;
+
+    // Contents when the file could not be mapped
+    std::vector<uint8_t> m_buffer;
+    bool m_mapped;
+};
@@ -0,0 +1,246 @@
+#include <movie.h>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+
+// Version 1 had no quirks, its movies were recorded with the defaults
+static const char movie_magic[4] = {'Y', 'M', 'V', '2'};
+static const char movie_magic_v1[4] = {'Y', 'M', 'V', '1'};
+
+
+uint64_t fnv1a_hash(const std::vector<uint8_t>& data)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (uint8_t byte : data) {
+        hash ^= byte;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+// Little endian integers whatever the host, and LEB128 variable length
+// integers for the cycle deltas
+static void put_u32(std::vector<uint8_t>& out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+
+static void put_u64(std::vector<uint8_t>& out, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back((uint8_t)value);
+}
+
+
+// Reads from a buffer, throws when running past its end
+class MovieReader
+{
+public:
+    MovieReader(const std::vector<uint8_t>& data)
+        : m_data(data)
+        , m_pos(0)
+    {}
+
+    uint8_t u8()
+    {
+        if (m_pos >= m_data.size()) {
+            throw std::runtime_error("Truncated movie file");
+        }
+
+        return m_data[m_pos++];
+    }
+
+    uint32_t u32()
+    {
+        uint32_t value = 0;
+
+        for (int i = 0; i < 4; i++) {
+            value |= (uint32_t)u8() << (8 * i);
+        }
+
+        return value;
+    }
+
+    uint64_t u64()
+    {
+        uint64_t value = 0;
+
+        for (int i = 0; i < 8; i++) {
+            value |= (uint64_t)u8() << (8 * i);
+        }
+
+        return value;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = u8();
+
+            value |= (uint64_t)(byte & 0x7F) << shift;
+
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+
+        throw std::runtime_error("Invalid movie file");
+    }
+
+protected:
+    const std::vector<uint8_t>& m_data;
+    size_t m_pos;
+};
+
+
+Movie::Movie(uint64_t seed, uint32_t cycles_per_frame, uint64_t rom_hash, const Quirks& quirks)
+    : m_seed(seed)
+    , m_cycles_per_frame(cycles_per_frame)
+    , m_rom_hash(rom_hash)
+    , m_quirks(quirks)
+    , m_end_cycle(0)
+{
+}
+
+
+void Movie::record(uint64_t cycle, uint8_t key, bool pressed)
+{
+    m_events.push_back({cycle, key, pressed});
+}
+
+
+void Movie::save(const std::string& path) const
+{
+    std::vector<uint8_t> data(movie_magic, movie_magic + sizeof(movie_magic));
+
+    put_u64(data, m_seed);
+    put_u32(data, m_cycles_per_frame);
+    put_u64(data, m_rom_hash);
+    data.push_back(m_quirks.bits());
+    put_u64(data, m_end_cycle);
+    put_u32(data, (uint32_t)m_events.size());
+
+    uint64_t cycle = 0;
+
+    for (const Event& e : m_events) {
+        put_varint(data, e.cycle - cycle);
+        data.push_back(e.key | (e.pressed ? 0x80 : 0x00));
+
+        cycle = e.cycle;
+    }
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f(std::fopen(path.c_str(), "wb"), std::fclose);
+
+    if (!f || std::fwrite(data.data(), 1, data.size(), f.get()) != data.size()) {
+        throw std::runtime_error("Could not write the movie file " + path);
+    }
+}
+
+
+Movie Movie::load(const std::string& path)
+{
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f(std::fopen(path.c_str(), "rb"), std::fclose);
+
+    if (!f) {
+        throw std::runtime_error("Could not open the movie file " + path);
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t n;
+
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f.get())) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+
+    const bool v1 = data.size() >= sizeof(movie_magic_v1)
+                 && std::memcmp(data.data(), movie_magic_v1, sizeof(movie_magic_v1)) == 0;
+
+    if (!v1 && (data.size() < sizeof(movie_magic) || std::memcmp(data.data(), movie_magic, sizeof(movie_magic)) != 0)) {
+        throw std::runtime_error("Not a movie file: " + path);
+    }
+
+    MovieReader reader(data);
+
+    for (size_t i = 0; i < sizeof(movie_magic); i++) {
+        reader.u8();
+    }
+
+    const uint64_t seed             = reader.u64();
+    const uint32_t cycles_per_frame = reader.u32();
+    const uint64_t hash             = reader.u64();
+    const Quirks quirks             = v1 ? Quirks() : Quirks::fromBits(reader.u8());
+    const uint64_t end_cycle        = reader.u64();
+    const uint32_t n_events         = reader.u32();
+
+    if (cycles_per_frame == 0) {
+        throw std::runtime_error("Invalid movie file");
+    }
+
+    Movie movie(seed, cycles_per_frame, hash, quirks);
+    movie.setEndCycle(end_cycle);
+
+    uint64_t cycle = 0;
+
+    for (uint32_t i = 0; i < n_events; i++) {
+        cycle += reader.varint();
+
+        const uint8_t byte = reader.u8();
+
+        movie.record(cycle, byte & 0xF, (byte & 0x80) != 0);
+    }
+
+    return movie;
+}
+
+
+MoviePlayer::MoviePlayer(const Movie& movie)
+    : m_movie(movie)
+    , m_next(0)
+{
+}
+
+
+void MoviePlayer::apply(Computer& computer)
+{
+    const std::vector<Movie::Event>& events = m_movie.events();
+
+    while (m_next < events.size() && events[m_next].cycle <= computer.cycle()) {
+        const Movie::Event& e = events[m_next++];
+
+        if (e.pressed) {
+            computer.keyPress(e.key);
+        } else {
+            computer.keyRelease(e.key);
+        }
+    }
+}
+
+
+uint64_t MoviePlayer::nextCycle() const
+{
+    return finished() ? UINT64_MAX : m_movie.events()[m_next].cycle;
+}
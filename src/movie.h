@@ -0,0 +1,83 @@
+#pragma once
+
+#include <computer.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// FNV-1a hash, identifies the ROM a movie was recorded with and the final
+// screen of a headless replay
+uint64_t fnv1a_hash(const std::vector<uint8_t>& data);
+
+
+// Key events with the emulated cycle at which they took effect, along with
+// what is needed to start the computer in the same state: seed, cycles per
+// frame and quirks. Replaying them at
+// the same cycles reproduces a run exactly.
+//
+// The file stores the cycles as variable length deltas, a few bytes per
+// event.
+class Movie
+{
+public:
+    struct Event {
+        uint64_t cycle;
+        uint8_t key;
+        bool pressed;
+    };
+
+    Movie(
+        uint64_t seed = 0,
+        uint32_t cycles_per_frame = 10,
+        uint64_t rom_hash = 0,
+        const Quirks& quirks = Quirks());
+
+    // Events must be recorded in cycle order
+    void record(uint64_t cycle, uint8_t key, bool pressed);
+
+    // Cycle at which the recording stopped
+    void setEndCycle(uint64_t cycle) { m_end_cycle = cycle; }
+
+    // Both throw a std::runtime_error on failure
+    void save(const std::string& path) const;
+    static Movie load(const std::string& path);
+
+    uint64_t seed() const { return m_seed; }
+    uint32_t cyclesPerFrame() const { return m_cycles_per_frame; }
+    uint64_t romHash() const { return m_rom_hash; }
+    const Quirks& quirks() const { return m_quirks; }
+    uint64_t endCycle() const { return m_end_cycle; }
+
+    const std::vector<Event>& events() const { return m_events; }
+
+protected:
+    uint64_t m_seed;
+    uint32_t m_cycles_per_frame;
+    uint64_t m_rom_hash;
+    Quirks m_quirks;
+    uint64_t m_end_cycle;
+
+    std::vector<Event> m_events;
+};
+
+
+// Feeds the events of a movie back to a computer
+class MoviePlayer
+{
+public:
+    MoviePlayer(const Movie& movie);
+
+    // Apply the events due at the current cycle of the computer
+    void apply(Computer& computer);
+
+    // Cycle of the next event, UINT64_MAX once all were applied
+    uint64_t nextCycle() const;
+
+    bool finished() const { return m_next == m_movie.events().size(); }
+
+protected:
+    const Movie& m_movie;
+    size_t m_next;
+};
@@ -0,0 +1,166 @@
+#include <options.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if (std::strcmp(arg, "--latency") == 0) {
+            options.measure_latency = true;
+        } else if (std::strcmp(arg, "--phosphor") == 0) {
+            options.phosphor = true;
+        } else if (std::strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        } else if (std::strcmp(arg, "--detect-quirks") == 0) {
+            options.detect_quirks = true;
+        } else if (std::strcmp(arg, "--rom-db") == 0 && i + 1 < argc) {
+            options.rom_db_path = argv[++i];
+        } else if (std::strcmp(arg, "--rom-db-save") == 0) {
+            options.rom_db_save = true;
+        } else if (std::strcmp(arg, "--quirks") == 0 && i + 1 < argc) {
+            if (!Quirks::parse(argv[++i], options.quirks)) {
+                std::cerr << "Quirks are none or a list of shift,load-store" << std::endl;
+                return false;
+            }
+        } else if (std::strcmp(arg, "--shm") == 0 && i + 1 < argc) {
+            options.shm_name = argv[++i];
+        } else if (std::strcmp(arg, "--capture") == 0 && i + 1 < argc) {
+            options.capture_path = argv[++i];
+        } else if (std::strcmp(arg, "--capture-format") == 0 && i + 1 < argc) {
+            if (!VideoCapture::parseFormat(argv[++i], options.capture_format)) {
+                std::cerr << "The capture format is y4m or monob" << std::endl;
+                return false;
+            }
+
+            options.capture_format_set = true;
+        } else if (std::strcmp(arg, "--record") == 0 && i + 1 < argc) {
+            options.record_path = argv[++i];
+        } else if (std::strcmp(arg, "--replay") == 0 && i + 1 < argc) {
+            options.replay_path = argv[++i];
+        } else if (std::strcmp(arg, "--software") == 0) {
+            options.software = true;
+        } else if (std::strcmp(arg, "--pacing-stats") == 0) {
+            options.pacing_stats = true;
+        } else if (std::strcmp(arg, "--speed") == 0 && i + 1 < argc) {
+            options.speed = std::strtod(argv[++i], nullptr);
+
+            if (!(options.speed >= Options::min_speed && options.speed <= Options::max_speed)) {
+                std::cerr << "The speed multiplier is between 0.125 and 8" << std::endl;
+                return false;
+            }
+        } else if ((std::strcmp(arg, "--fg") == 0
+                 || std::strcmp(arg, "--bg") == 0
+                 || std::strcmp(arg, "--fg2") == 0
+                 || std::strcmp(arg, "--blend") == 0) && i + 1 < argc) {
+            const char* value = argv[++i];
+            char* end;
+            const unsigned long rgb = std::strtoul(value, &end, 16);
+
+            if (std::strlen(value) != 6 || *end != '\0') {
+                std::cerr << "Colours are given as RRGGBB" << std::endl;
+                return false;
+            }
+
+            if (std::strcmp(arg, "--fg") == 0) {
+                options.foreground = (uint32_t)rgb;
+            } else if (std::strcmp(arg, "--bg") == 0) {
+                options.background = (uint32_t)rgb;
+            } else if (std::strcmp(arg, "--fg2") == 0) {
+                options.foreground2 = (uint32_t)rgb;
+            } else {
+                options.blend = (uint32_t)rgb;
+            }
+        } else if (std::strcmp(arg, "--seed") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            char* end;
+
+            options.seed = std::strtoull(value, &end, 0);
+            options.seed_set = true;
+
+            if (*value == '\0' || *end != '\0') {
+                std::cerr << "Invalid seed" << std::endl;
+                return false;
+            }
+        } else if (std::strcmp(arg, "--audio-buffer") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            char* end;
+
+            const long samples = std::strtol(value, &end, 10);
+
+            if (*value == '\0' || *end != '\0' || samples < 64 || samples > 8192 || (samples & (samples - 1)) != 0) {
+                std::cerr << "The audio buffer is a power of two between 64 and 8192 samples" << std::endl;
+                return false;
+            }
+
+            options.audio_buffer = (int)samples;
+        } else if (std::strcmp(arg, "--cpf") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            char* end;
+
+            const long cpf = std::strtol(value, &end, 10);
+
+            if (*value == '\0' || *end != '\0' || cpf <= 0 || cpf > (long)Options::max_cycles_per_frame) {
+                std::cerr << "The number of cycles per frame is between 1 and " << Options::max_cycles_per_frame << std::endl;
+                return false;
+            }
+
+            options.cycles_per_frame = (uint32_t)cpf;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        } else if (options.rom_path.empty()) {
+            options.rom_path = arg;
+        } else {
+            std::cerr << "Only one ROM can be given" << std::endl;
+            return false;
+        }
+    }
+
+    if (!options.capture_format_set) {
+        options.capture_format = VideoCapture::defaultFormat(options.capture_path);
+    }
+
+    if (options.headless && options.replay_path.empty()) {
+        std::cerr << "--headless needs a movie to --replay" << std::endl;
+        return false;
+    }
+
+    return !options.rom_path.empty();
+}
+
+
+void print_usage(std::ostream& os, const char* program)
+{
+    os << "Usage:" << std::endl
+       << "------" << std::endl
+       << program << " [options] <chip8_rom>" << std::endl
+       << std::endl
+       << "Options:" << std::endl
+       << "  --cpf <n>          Instructions executed per 60 Hz frame, 1 to 1000000 (default: 10)" << std::endl
+       << "  --speed <x>        Emulation speed multiplier, 0.125 to 8 (default: 1)" << std::endl
+       << "  --quirks <list>    shift,load-store or none (default: " << Quirks().name() << ")" << std::endl
+       << "  --detect-quirks    Run every quirk combination and recommend one" << std::endl
+       << "  --rom-db <file>    Settings of known ROMs (default: $YACHE_ROM_DB)" << std::endl
+       << "  --rom-db-save      Store the settings of the ROM in the database" << std::endl
+       << "  --fg <RRGGBB>      Colour of the set pixels (default: FFFFFF)" << std::endl
+       << "  --bg <RRGGBB>      Colour of the unset pixels (default: 000000)" << std::endl
+       << "  --fg2 <RRGGBB>     Colour of the XO-CHIP second plane (default: AAAAAA)" << std::endl
+       << "  --blend <RRGGBB>   Colour of pixels set in both planes (default: 555555)" << std::endl
+       << "  --shm <name>       Export the machine state to POSIX shared memory" << std::endl
+       << "  --capture <file>   Write the frames to a video file, - for the standard output" << std::endl
+       << "  --capture-format <f> y4m or monob (default: y4m for .y4m files and -, else monob)" << std::endl
+       << "  --record <file>    Record the key events to a movie file" << std::endl
+       << "  --replay <file>    Replay the key events of a movie file" << std::endl
+       << "  --headless         Replay without window nor sound, as fast as possible" << std::endl
+       << "  --seed <n>         Seed of the random numbers, to reproduce a run" << std::endl
+       << "  --audio-buffer <n> Audio device buffer in samples (default: 512)" << std::endl
+       << "  --phosphor         Fade pixels out like a CRT to hide sprite flicker" << std::endl
+       << "  --software         Scale the screen on the CPU, for hosts without GPU" << std::endl
+       << "  --latency          Measure input latency and report it at exit" << std::endl
+       << "  --pacing-stats     Report the frame pacing jitter at exit" << std::endl;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <capture.h>
+#include <computer.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Settings of the frontend given on the command line
+struct Options
+{
+    std::string rom_path;
+
+    // Number of instructions executed for each 60 Hz frame
+    uint32_t cycles_per_frame = 10;
+
+    static constexpr uint32_t max_cycles_per_frame = 1000000;
+
+    // Interpreter variant the ROM was written for
+    Quirks quirks;
+
+    // Run the ROM under every quirk combination and recommend one
+    bool detect_quirks = false;
+
+    // Database of the settings of known ROMs, see RomDatabase. Saving
+    // stores the settings given, or the detected quirks, for the ROM.
+    std::string rom_db_path;
+    bool rom_db_save = false;
+
+    // Emulation speed multiplier at startup, also the range of the speed
+    // hotkeys
+    double speed = 1.;
+
+    static constexpr double min_speed = 1. / 8.;
+    static constexpr double max_speed = 8.;
+
+    // Colours of the set and unset pixels, as 0xRRGGBB
+    uint32_t foreground = 0xFFFFFF;
+    uint32_t background = 0x000000;
+
+    // Colours of the pixels set in the second XO-CHIP plane only and in both
+    // planes
+    uint32_t foreground2 = 0xAAAAAA;
+    uint32_t blend       = 0x555555;
+
+    // Emulate the persistence of a CRT phosphor to hide flickering sprites
+    bool phosphor = false;
+
+    // Scale the screen on the CPU to the window surface, without renderer
+    bool software = false;
+
+    // Seed of the CXNN random numbers, drawn at startup unless given
+    uint64_t seed = 0;
+    bool seed_set = false;
+
+    // Movie files to record the key events to or to replay them from. A
+    // headless replay runs as fast as possible without window nor sound.
+    std::string record_path;
+    std::string replay_path;
+    bool headless = false;
+
+    // Video file of the emulated frames, see VideoCapture. The format
+    // depends on the path unless given.
+    std::string capture_path;
+    VideoCapture::Format capture_format = VideoCapture::FORMAT_MONOB;
+    bool capture_format_set = false;
+
+    // Name of the shared memory segment the state is exported to
+    std::string shm_name;
+
+    // Size of the audio device buffer in samples, a power of two
+    int audio_buffer = 512;
+
+    // Measure the input to photon latency and report it at exit
+    bool measure_latency = false;
+
+    // Report the frame pacing jitter at exit
+    bool pacing_stats = false;
+};
+
+
+// Fill options from the command line, returns false if it is not valid
+bool parse_options(int argc, char* argv[], Options& options);
+
+void print_usage(std::ostream& os, const char* program);
@@ -0,0 +1,98 @@
+#include <pacer.h>
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+
+Pacer::Pacer(double frequency_Hz)
+    : m_counter_freq(SDL_GetPerformanceFrequency())
+    , m_n_waits(0)
+    , m_n_resyncs(0)
+    , m_late_sum_us(0.)
+    , m_late_sq_sum_us(0.)
+    , m_late_max_us(0.)
+{
+    setFrequency(frequency_Hz);
+    reset();
+}
+
+
+void Pacer::wait()
+{
+    // Next deadline, accumulating the fractional part of the period
+    m_deadline      += m_period;
+    m_deadline_frac += m_period_frac;
+
+    if (m_deadline_frac >= 1.) {
+        m_deadline      += 1;
+        m_deadline_frac -= 1.;
+    }
+
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    if (now > m_deadline + max_late_periods * m_period) {
+        // We are too late, catching up would run a burst of frames
+        m_n_resyncs++;
+        m_deadline      = now;
+        m_deadline_frac = 0.;
+        return;
+    }
+
+    const uint64_t spin_ticks = (uint64_t)(spin_us * 1e-6 * m_counter_freq);
+
+    if (now + spin_ticks < m_deadline) {
+        const double sleep_us = 1e6 * (m_deadline - spin_ticks - now) / m_counter_freq;
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)sleep_us));
+    }
+
+    do {
+        now = SDL_GetPerformanceCounter();
+    } while (now < m_deadline);
+
+    const double late_us = 1e6 * (now - m_deadline) / m_counter_freq;
+
+    m_n_waits++;
+    m_late_sum_us    += late_us;
+    m_late_sq_sum_us += late_us * late_us;
+    m_late_max_us     = std::max(m_late_max_us, late_us);
+}
+
+
+void Pacer::reset()
+{
+    m_deadline      = SDL_GetPerformanceCounter();
+    m_deadline_frac = 0.;
+}
+
+
+void Pacer::setFrequency(double frequency_Hz)
+{
+    const double period = (double)m_counter_freq / frequency_Hz;
+
+    m_period      = (uint64_t)period;
+    m_period_frac = period - (double)m_period;
+}
+
+
+void Pacer::report(std::ostream& os) const
+{
+    os << "Pacing: " << m_n_waits << " frames, "
+       << m_n_resyncs << " resyncs" << std::endl;
+
+    if (m_n_waits == 0) {
+        return;
+    }
+
+    const double mean   = m_late_sum_us / m_n_waits;
+    const double stddev = std::sqrt(std::max(0., m_late_sq_sum_us / m_n_waits - mean * mean));
+
+    os << std::fixed << std::setprecision(1)
+       << "  lateness (us): mean=" << mean
+       << " stddev=" << stddev
+       << " max=" << m_late_max_us << std::endl;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Paces a loop at a fixed frequency.
+//
+// Deadlines are absolute positions of the high resolution performance counter
+// and the fractional part of the period is accumulated, so the average
+// frequency is exact. The thread sleeps until shortly before the deadline and
+// spins for the remaining time.
+class Pacer
+{
+public:
+    Pacer(double frequency_Hz);
+
+    // Block until the next deadline
+    void wait();
+
+    // Restart the deadlines from now
+    void reset();
+
+    void setFrequency(double frequency_Hz);
+
+    // Print statistics about how late the deadlines were met
+    void report(std::ostream& os) const;
+
+protected:
+    // Time before the deadline at which we stop sleeping and start spinning
+    static constexpr double spin_us =
+    #ifdef _WIN32
+        2000.;
+    #else
+        300.;
+    #endif
+
+    // If we are that many periods behind, we give up on catching up
+    static constexpr uint64_t max_late_periods = 4;
+
+    uint64_t m_counter_freq;
+
+    uint64_t m_period;
+    double   m_period_frac;
+
+    uint64_t m_deadline;
+    double   m_deadline_frac;
+
+    // Jitter statistics, in microseconds
+    uint64_t m_n_waits;
+    uint64_t m_n_resyncs;
+    double   m_late_sum_us;
+    double   m_late_sq_sum_us;
+    double   m_late_max_us;
+};
@@ -0,0 +1,107 @@
+#include <phosphor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PHOSPHOR_SSE2
+#endif
+
+
+PhosphorFilter::PhosphorFilter(int width, int height, float persistence)
+    : m_width(width)
+    , m_height(height)
+    , m_persistence(persistence)
+    , m_fading(false)
+    , m_intensity(width * height, 0)
+{
+    for (int byte = 0; byte < 256; byte++) {
+        uint8_t mask[8];
+
+        for (int i = 0; i < 8; i++) {
+            mask[i] = (byte & (0x80 >> i)) ? 0xFF : 0x00;
+        }
+
+        std::memcpy(&m_byte_mask[byte], mask, sizeof(mask));
+    }
+}
+
+
+#if defined(PHOSPHOR_SSE2)
+
+uint64_t PhosphorFilter::update(const uint8_t* screen, double dt)
+{
+    // Intensity multiplier as 8.8 fixed point
+    const int decay = std::min(256, (int)(256. * std::pow(m_persistence, 60. * dt)));
+
+    const __m128i factor = _mm_set1_epi16((short)decay);
+    const __m128i zero   = _mm_setzero_si128();
+
+    uint64_t changed_rows = 0;
+    __m128i fading = zero;
+
+    // 16 pixels per iteration: decay, then saturate the lit pixels
+    for (int y = 0; y < m_height; y++) {
+        __m128i changed = zero;
+
+        for (int x = 0; x < m_width; x += 16) {
+            uint8_t* p = &m_intensity[y * m_width + x];
+            const uint8_t* bits = &screen[(y * m_width + x) / 8];
+
+            const __m128i before = _mm_loadu_si128((const __m128i*)p);
+            const __m128i lit = _mm_set_epi64x(
+                (long long)m_byte_mask[bits[1]],
+                (long long)m_byte_mask[bits[0]]);
+
+            const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(before, zero), factor), 8);
+            const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(before, zero), factor), 8);
+            const __m128i decayed = _mm_packus_epi16(lo, hi);
+
+            const __m128i after = _mm_or_si128(decayed, lit);
+
+            _mm_storeu_si128((__m128i*)p, after);
+
+            changed = _mm_or_si128(changed, _mm_xor_si128(before, after));
+            fading  = _mm_or_si128(fading, _mm_andnot_si128(lit, after));
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(changed, zero)) != 0xFFFF) {
+            changed_rows |= (uint64_t)1 << y;
+        }
+    }
+
+    m_fading = _mm_movemask_epi8(_mm_cmpeq_epi8(fading, zero)) != 0xFFFF;
+
+    return changed_rows;
+}
+
+#else
+
+uint64_t PhosphorFilter::update(const uint8_t* screen, double dt)
+{
+    const int decay = std::min(256, (int)(256. * std::pow(m_persistence, 60. * dt)));
+
+    uint64_t changed_rows = 0;
+    m_fading = false;
+
+    for (int y = 0; y < m_height; y++) {
+        for (int x = 0; x < m_width; x++) {
+            uint8_t& p = m_intensity[y * m_width + x];
+            const bool lit = (screen[(y * m_width + x) / 8] >> (7 - x % 8)) & 1;
+            const uint8_t after = lit ? 0xFF : (uint8_t)((p * decay) >> 8);
+
+            if (after != p) {
+                changed_rows |= (uint64_t)1 << y;
+            }
+
+            m_fading = m_fading || (!lit && after != 0);
+            p = after;
+        }
+    }
+
+    return changed_rows;
+}
+
+#endif
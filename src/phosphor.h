@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Emulates the persistence of a CRT phosphor, to hide the flicker of sprites
+// erased and drawn again each frame with XOR.
+//
+// Each pixel has an 8 bit intensity which is set to full when the pixel is
+// on and otherwise decays exponentially.
+class PhosphorFilter
+{
+public:
+    // persistence is the fraction of the intensity left after 1/60 s
+    PhosphorFilter(int width, int height, float persistence = 0.5f);
+
+    // Decay the intensities for dt seconds then light the pixels set in the
+    // 1 bit per pixel screen. Returns the rows whose intensities changed.
+    uint64_t update(const uint8_t* screen, double dt);
+
+    // True while some pixels are neither off nor fully lit
+    bool fading() const { return m_fading; }
+
+    // width * height intensities, row by row
+    const uint8_t* intensities() const { return m_intensity.data(); }
+
+protected:
+    int m_width;
+    int m_height;
+
+    float m_persistence;
+    bool m_fading;
+
+    std::vector<uint8_t> m_intensity;
+
+    // The 8 pixels of each byte value as 0x00 or 0xFF bytes
+    std::array<uint64_t, 256> m_byte_mask;
+};
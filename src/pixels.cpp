@@ -0,0 +1,138 @@
+#include <pixels.h>
+
+#include <cstring>
+
+// Only the wide stores of the scaled pixels use SSE2, expanding one pixel per
+// bit is faster from the nibble table than with any vector kernel
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIXELS_SSE2
+#endif
+
+
+// Write scale copies of a pixel
+static inline void replicate(uint32_t pixel, int scale, uint32_t* out)
+{
+#if defined(PIXELS_SSE2)
+    // 4 pixels stores, the last one overlaps the previous ones when scale is
+    // not a multiple of 4
+    if (scale >= 4) {
+        const __m128i v = _mm_set1_epi32(pixel);
+
+        int j = 0;
+
+        for (; j + 4 <= scale; j += 4) {
+            _mm_storeu_si128((__m128i*)(out + j), v);
+        }
+
+        if (j < scale) {
+            _mm_storeu_si128((__m128i*)(out + scale - 4), v);
+        }
+
+        return;
+    }
+#endif
+
+    for (int j = 0; j < scale; j++) {
+        out[j] = pixel;
+    }
+}
+
+
+uint32_t pack_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    const uint8_t bytes[4] = {r, g, b, a};
+    uint32_t pixel;
+
+    std::memcpy(&pixel, bytes, sizeof(pixel));
+
+    return pixel;
+}
+
+
+uint32_t pack_rgb(uint32_t rgb)
+{
+    return pack_rgba((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+}
+
+
+PixelExpander::PixelExpander(const Palette& palette)
+    : m_palette(palette)
+    , m_fg(palette[1])
+    , m_bg(palette[0])
+{
+    const uint32_t fg = m_fg;
+    const uint32_t bg = m_bg;
+
+    for (int nibble = 0; nibble < 16; nibble++) {
+        for (int i = 0; i < 4; i++) {
+            m_nibble_lut[nibble][i] = (nibble & (0x8 >> i)) ? fg : bg;
+        }
+    }
+
+    // Each channel is blended on its own so the pixel format does not matter
+    for (int shade = 0; shade < 256; shade++) {
+        uint32_t pixel = 0;
+
+        for (int shift = 0; shift < 32; shift += 8) {
+            const int c_fg = (fg >> shift) & 0xFF;
+            const int c_bg = (bg >> shift) & 0xFF;
+            const int c = (c_bg * (255 - shade) + c_fg * shade + 127) / 255;
+
+            pixel |= (uint32_t)c << shift;
+        }
+
+        m_shade_lut[shade] = pixel;
+    }
+}
+
+
+void PixelExpander::expand(const uint8_t* bits, size_t n_bytes, uint32_t* out) const
+{
+    for (size_t i = 0; i < n_bytes; i++) {
+        std::memcpy(out + 8 * i,     m_nibble_lut[bits[i] >> 4].data(),  4 * sizeof(uint32_t));
+        std::memcpy(out + 8 * i + 4, m_nibble_lut[bits[i] & 0xF].data(), 4 * sizeof(uint32_t));
+    }
+}
+
+
+void PixelExpander::expandScaled(const uint8_t* bits, size_t n_bytes, int scale, uint32_t* out) const
+{
+    for (size_t i = 0; i < n_bytes; i++) {
+        for (int b = 7; b >= 0; b--) {
+            replicate(((bits[i] >> b) & 1) ? m_fg : m_bg, scale, out);
+            out += scale;
+        }
+    }
+}
+
+
+void PixelExpander::expandPlanes(const uint8_t* first, const uint8_t* second, size_t n_bytes, int scale, uint32_t* out) const
+{
+    for (size_t i = 0; i < n_bytes; i++) {
+        for (int b = 7; b >= 0; b--) {
+            const int index = ((first[i] >> b) & 1) | (((second[i] >> b) & 1) << 1);
+
+            replicate(m_palette[index], scale, out);
+            out += scale;
+        }
+    }
+}
+
+
+void PixelExpander::expandShades(const uint8_t* shades, size_t n_pixels, int scale, uint32_t* out) const
+{
+    if (scale == 1) {
+        for (size_t i = 0; i < n_pixels; i++) {
+            out[i] = m_shade_lut[shades[i]];
+        }
+
+        return;
+    }
+
+    for (size_t i = 0; i < n_pixels; i++) {
+        replicate(m_shade_lut[shades[i]], scale, out);
+        out += scale;
+    }
+}
+
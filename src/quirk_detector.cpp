@@ -0,0 +1,161 @@
+#include <quirk_detector.h>
+
+#include <algorithm>
+#include <thread>
+
+
+QuirkDetector::QuirkDetector(
+    const std::vector<uint8_t>& program,
+    uint32_t cycles_per_frame,
+    uint64_t seed,
+    const Movie* script)
+    : m_program(program)
+    , m_cycles_per_frame(cycles_per_frame)
+    , m_seed(seed)
+    , m_script(script)
+{
+}
+
+
+std::vector<Quirks> QuirkDetector::profiles()
+{
+    std::vector<Quirks> quirks;
+
+    for (int shift_vx = 0; shift_vx < 2; shift_vx++) {
+        for (int load_store_increment = 0; load_store_increment < 2; load_store_increment++) {
+            Quirks q;
+            q.shift_vx = shift_vx;
+            q.load_store_increment = load_store_increment;
+
+            if (q == Quirks()) {
+                quirks.insert(quirks.begin(), q);
+            } else {
+                quirks.push_back(q);
+            }
+        }
+    }
+
+    return quirks;
+}
+
+
+std::vector<QuirkDetector::Result> QuirkDetector::run(uint64_t frames) const
+{
+    if (m_script) {
+        frames = m_script->endCycle() / m_cycles_per_frame;
+    }
+
+    const Movie script = m_script ? *m_script : defaultScript(frames);
+
+    const std::vector<Quirks> quirks = profiles();
+    std::vector<Result> results(quirks.size());
+    std::vector<std::thread> threads;
+
+    // The computers share nothing, each run gets a thread
+    for (size_t i = 0; i < quirks.size(); i++) {
+        threads.emplace_back([this, &results, &quirks, &script, frames, i]() {
+            results[i] = runProfile(quirks[i], script, frames);
+        });
+    }
+
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    // The fewer kinds of faults the better, then the fewer faults. Among
+    // equals the stable sort keeps the default profile first.
+    std::stable_sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+        if (a.faultKinds() != b.faultKinds()) {
+            return a.faultKinds() < b.faultKinds();
+        }
+
+        return a.faults() < b.faults();
+    });
+
+    return results;
+}
+
+
+uint64_t QuirkDetector::firstDivergence(const Result& a, const Result& b)
+{
+    const size_t n = std::min(a.frame_hashes.size(), b.frame_hashes.size());
+
+    for (size_t f = 0; f < n; f++) {
+        if (a.frame_hashes[f] != b.frame_hashes[f]) {
+            return f;
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+
+Movie QuirkDetector::defaultScript(uint64_t frames) const
+{
+    Movie script(m_seed, m_cycles_per_frame);
+
+    // Each key held for 6 frames, the next one 20 frames later
+    uint8_t key = 0;
+
+    for (uint64_t f = Computer::timer_Hz; f + 6 < frames; f += 20) {
+        script.record(f * m_cycles_per_frame, key, true);
+        script.record((f + 6) * m_cycles_per_frame, key, false);
+
+        key = (key + 1) % 16;
+    }
+
+    script.setEndCycle(frames * m_cycles_per_frame);
+
+    return script;
+}
+
+
+QuirkDetector::Result QuirkDetector::runProfile(const Quirks& quirks, const Movie& script, uint64_t frames) const
+{
+    Computer computer(m_program, m_cycles_per_frame, m_seed, quirks);
+    MoviePlayer player(script);
+
+    Result result;
+    result.quirks = quirks;
+    result.screen_changes = 0;
+    result.frame_hashes.reserve(frames);
+
+    std::vector<uint8_t> screen(2 * 1024);
+    uint64_t screen_hash = 0;
+    uint64_t hashed_generation = computer.screenGeneration() - 1;
+
+    // Split at the same cycles as a replay, idle periods are skipped
+    for (uint64_t f = 0; f < frames; f++) {
+        const uint64_t frame_end = (f + 1) * m_cycles_per_frame;
+
+        while (computer.cycle() < frame_end) {
+            player.apply(computer);
+            computer.advance(std::min(player.nextCycle(), frame_end));
+        }
+
+        if (computer.screenGeneration() != hashed_generation) {
+            hashed_generation = computer.screenGeneration();
+
+            std::fill(screen.begin(), screen.end(), 0);
+            computer.screenBits(screen.data(), 0);
+            computer.screenBits(screen.data() + 1024, 1);
+
+            const uint64_t hash = fnv1a_hash(screen);
+
+            if (hash != screen_hash) {
+                result.screen_changes++;
+                screen_hash = hash;
+            }
+        }
+
+        result.frame_hashes.push_back(screen_hash);
+    }
+
+    const Diagnostics& diagnostics = computer.diagnostics();
+
+    result.unknown_opcodes = diagnostics.count(Diagnostics::UNKNOWN_OPCODE);
+    result.stack_faults    = diagnostics.count(Diagnostics::STACK_OVERFLOW) + diagnostics.count(Diagnostics::STACK_UNDERFLOW);
+    result.out_of_bounds   = diagnostics.count(Diagnostics::OUT_OF_BOUNDS);
+
+    return result;
+}
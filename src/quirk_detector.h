@@ -0,0 +1,72 @@
+#pragma once
+
+#include <computer.h>
+#include <movie.h>
+
+#include <cstdint>
+#include <vector>
+
+// Finds the quirks a ROM was written for by running it under every
+// combination at once, one thread each, with the same seed and input.
+//
+// A run is scored down for each kind of fault met: unknown opcodes, stack
+// faults and accesses past the 4 KiB of the classic machines are what a
+// program running with the wrong quirks typically ends up doing. The screen
+// of every frame is hashed so the runs which stay clean can still be told
+// apart.
+class QuirkDetector
+{
+public:
+    struct Result {
+        Quirks quirks;
+
+        uint64_t unknown_opcodes;
+        uint64_t stack_faults;
+        uint64_t out_of_bounds;
+
+        // Number of frames on which the screen changed
+        uint64_t screen_changes;
+
+        // Hash of the screen at each frame
+        std::vector<uint64_t> frame_hashes;
+
+        // Number of the kinds of fault met, the lower the better
+        int faultKinds() const
+        {
+            return (unknown_opcodes > 0) + (stack_faults > 0) + (out_of_bounds > 0);
+        }
+
+        uint64_t faults() const { return unknown_opcodes + stack_faults + out_of_bounds; }
+    };
+
+    // Without a movie, the keys are pressed one after the other after the
+    // first second, long enough for the program to notice
+    QuirkDetector(
+        const std::vector<uint8_t>& program,
+        uint32_t cycles_per_frame,
+        uint64_t seed,
+        const Movie* script = nullptr);
+
+    // Every combination of quirks, the default one first
+    static std::vector<Quirks> profiles();
+
+    // Run each profile for the given number of frames, or up to the end of
+    // the movie. The results are sorted from the most plausible profile.
+    std::vector<Result> run(uint64_t frames) const;
+
+    // First frame on which two runs show a different screen, UINT64_MAX if
+    // none
+    static uint64_t firstDivergence(const Result& a, const Result& b);
+
+protected:
+    // The keys pressed without a movie
+    Movie defaultScript(uint64_t frames) const;
+
+    Result runProfile(const Quirks& quirks, const Movie& script, uint64_t frames) const;
+
+    const std::vector<uint8_t>& m_program;
+    uint32_t m_cycles_per_frame;
+    uint64_t m_seed;
+
+    const Movie* m_script;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+// PCG32 random number generator (XSH RR variant). Small enough for every
+// Computer to own one, so runs are reproducible from their seed and
+// instances on different threads share no state.
+class Pcg32
+{
+public:
+    explicit Pcg32(uint64_t value = 0)
+    {
+        seed(value);
+    }
+
+    void seed(uint64_t value)
+    {
+        m_state = 0;
+        next();
+        m_state += value;
+        next();
+    }
+
+    uint32_t next()
+    {
+        const uint64_t state = m_state;
+        m_state = state * 6364136223846793005ULL + increment;
+
+        const uint32_t xorshifted = (uint32_t)(((state >> 18) ^ state) >> 27);
+        const uint32_t rot = (uint32_t)(state >> 59);
+
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+protected:
+    static constexpr uint64_t increment = 1442695040888963407ULL;
+
+    uint64_t m_state;
+};
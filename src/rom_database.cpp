@@ -0,0 +1,188 @@
+#include <rom_database.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+
+static const char database_magic[4] = {'Y', 'R', 'D', 'B'};
+
+static constexpr size_t header_size = 16;
+static constexpr size_t record_size = 32;
+
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint64_t get_u64(const uint8_t* p)
+{
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+
+static void put_u64(uint8_t* p, uint64_t value)
+{
+    put_u32(p, (uint32_t)value);
+    put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+
+RomDatabase::RomDatabase(const std::string& path)
+    : m_file(new MappedFile(path))
+    , m_records(nullptr)
+    , m_record_size(record_size)
+    , m_count(0)
+{
+    const uint8_t* data = m_file->data();
+
+    // Header: magic, version, number of records, size of a record
+    if (m_file->size() < header_size || std::memcmp(data, database_magic, sizeof(database_magic)) != 0) {
+        throw std::runtime_error("Not a ROM database: " + path);
+    }
+
+    const uint32_t version = get_u32(data + 4);
+    const uint32_t count   = get_u32(data + 8);
+    const uint32_t size    = get_u32(data + 12);
+
+    // Later versions may only grow the records
+    if (version != 1 || size < record_size || (m_file->size() - header_size) / size < count) {
+        throw std::runtime_error("Invalid ROM database: " + path);
+    }
+
+    m_records     = data + header_size;
+    m_record_size = size;
+    m_count       = count;
+}
+
+
+bool RomDatabase::find(uint64_t hash, Entry& entry_found) const
+{
+    size_t lo = 0;
+    size_t hi = m_count;
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const uint64_t mid_hash = get_u64(m_records + mid * m_record_size);
+
+        if (mid_hash < hash) {
+            lo = mid + 1;
+        } else if (mid_hash > hash) {
+            hi = mid;
+        } else {
+            entry_found = entry(mid);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+std::vector<RomDatabase::Entry> RomDatabase::entries() const
+{
+    std::vector<Entry> all;
+    all.reserve(m_count);
+
+    for (size_t i = 0; i < m_count; i++) {
+        all.push_back(entry(i));
+    }
+
+    return all;
+}
+
+
+RomDatabase::Entry RomDatabase::entry(size_t i) const
+{
+    const uint8_t* r = m_records + i * m_record_size;
+
+    Entry e;
+    e.hash             = get_u64(r);
+    e.cycles_per_frame = get_u32(r + 8);
+    e.foreground       = get_u32(r + 12);
+    e.background       = get_u32(r + 16);
+    e.foreground2      = get_u32(r + 20);
+    e.blend            = get_u32(r + 24);
+
+    e.quirks           = Quirks::fromBits(r[28]);
+
+    // Checked when read, the file is not scanned when opened
+    if (e.cycles_per_frame == 0) {
+        throw std::runtime_error("Invalid ROM database record: 0 cycles per frame");
+    }
+
+    return e;
+}
+
+
+void RomDatabase::store(const std::string& path, const Entry& new_entry)
+{
+    std::vector<Entry> all;
+
+    // A missing file is an empty database, an invalid one is an error
+    if (std::FILE* f = std::fopen(path.c_str(), "rb")) {
+        std::fclose(f);
+        all = RomDatabase(path).entries();
+    }
+
+    std::vector<Entry>::iterator it = std::lower_bound(
+        all.begin(), all.end(), new_entry.hash,
+        [](const Entry& e, uint64_t hash) { return e.hash < hash; });
+
+    if (it != all.end() && it->hash == new_entry.hash) {
+        *it = new_entry;
+    } else {
+        all.insert(it, new_entry);
+    }
+
+    std::vector<uint8_t> data(header_size + all.size() * record_size, 0);
+
+    std::memcpy(data.data(), database_magic, sizeof(database_magic));
+    put_u32(&data[4], 1);
+    put_u32(&data[8], (uint32_t)all.size());
+    put_u32(&data[12], record_size);
+
+    for (size_t i = 0; i < all.size(); i++) {
+        const Entry& e = all[i];
+        uint8_t* r = &data[header_size + i * record_size];
+
+        put_u64(r, e.hash);
+        put_u32(r + 8, e.cycles_per_frame);
+        put_u32(r + 12, e.foreground);
+        put_u32(r + 16, e.background);
+        put_u32(r + 20, e.foreground2);
+        put_u32(r + 24, e.blend);
+
+        r[28] = e.quirks.bits();
+    }
+
+    // Running instances keep their mapping of the previous file
+    const std::string tmp_path = path + ".tmp";
+    bool written = false;
+
+    if (std::FILE* f = std::fopen(tmp_path.c_str(), "wb")) {
+        written = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+        written = (std::fclose(f) == 0) && written;
+    }
+
+    #ifdef _WIN32
+    // rename() does not replace an existing file there
+    std::remove(path.c_str());
+    #endif
+
+    if (!written || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("Could not write the ROM database " + path);
+    }
+}
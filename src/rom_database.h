@@ -0,0 +1,54 @@
+#pragma once
+
+#include <computer.h>
+#include <mapped_file.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Settings of known ROMs, found by the hash of their content.
+//
+// The file is an array of fixed size records sorted by hash after a small
+// header. It is memory mapped and searched in place with a binary search, so
+// opening it and looking a ROM up costs a few page reads whatever its size.
+// All the integers are little endian.
+class RomDatabase
+{
+public:
+    struct Entry {
+        uint64_t hash;
+        uint32_t cycles_per_frame;
+        Quirks quirks;
+
+        // 0xRRGGBB
+        uint32_t foreground;
+        uint32_t background;
+        uint32_t foreground2;
+        uint32_t blend;
+    };
+
+    // Throws a std::runtime_error if the file cannot be read or is invalid
+    RomDatabase(const std::string& path);
+
+    // Returns false if the ROM is unknown. Throws a std::runtime_error if
+    // its record is invalid.
+    bool find(uint64_t hash, Entry& entry) const;
+
+    size_t size() const { return m_count; }
+
+    std::vector<Entry> entries() const;
+
+    // Add the entry to the database, replacing the one of the same ROM. The
+    // file is created if missing and replaced atomically.
+    static void store(const std::string& path, const Entry& entry);
+
+protected:
+    Entry entry(size_t i) const;
+
+    std::unique_ptr<MappedFile> m_file;
+    const uint8_t* m_records;
+    size_t m_record_size;
+    size_t m_count;
+};
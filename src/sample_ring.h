@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free ring of samples for exactly one producer thread and one
+// consumer thread. Unlike SpscQueue, blocks of samples are written and read
+// at once with a single pair of atomic operations.
+template<typename T, size_t Capacity>
+class SampleRing
+{
+    static_assert(
+        Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+        "Capacity must be a power of two");
+
+public:
+    SampleRing()
+        : m_head(0)
+        , m_tail(0)
+    {}
+
+    // Producer side, writes as many samples as fit and returns their number
+    size_t write(const T* samples, size_t n)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t free = Capacity - (tail - m_head.load(std::memory_order_acquire));
+
+        n = std::min(n, free);
+
+        for (size_t i = 0; i < n; i++) {
+            m_samples[(tail + i) & (Capacity - 1)] = samples[i];
+        }
+
+        m_tail.store(tail + n, std::memory_order_release);
+
+        return n;
+    }
+
+    // Consumer side, reads up to n samples and returns their number
+    size_t read(T* samples, size_t n)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t available = m_tail.load(std::memory_order_acquire) - head;
+
+        n = std::min(n, available);
+
+        for (size_t i = 0; i < n; i++) {
+            samples[i] = m_samples[(head + i) & (Capacity - 1)];
+        }
+
+        m_head.store(head + n, std::memory_order_release);
+
+        return n;
+    }
+
+    // Number of samples waiting, exact from either side for its own end
+    size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire)
+             - m_head.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+protected:
+    std::array<T, Capacity> m_samples;
+
+    // Head and tail live on their own cache lines to avoid false sharing
+    // between the producer and the consumer
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
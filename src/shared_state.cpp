@@ -0,0 +1,147 @@
+#include <shared_state.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// The readers are other processes, the sequence has to work without any help
+// from this one
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The sequence must be lock free");
+
+
+#ifdef _WIN32
+
+SharedState::SharedState(const std::string& name)
+    : m_name(name)
+    , m_state(nullptr)
+    , m_published_generation(0)
+{
+    throw std::runtime_error("Shared memory export is not available on this platform");
+}
+
+
+SharedState::~SharedState()
+{
+}
+
+#else
+
+SharedState::SharedState(const std::string& name)
+    : m_name(name)
+    , m_state(nullptr)
+    , m_published_generation(0)
+{
+    // POSIX names start with a single slash
+    if (m_name.empty() || m_name[0] != '/') {
+        m_name = "/" + m_name;
+    }
+
+    // Another instance owns an existing segment, or it crashed and left it
+    // behind: either way it is not ours to overwrite nor to unlink
+    const int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            throw std::runtime_error(
+                "The shared memory segment " + m_name + " already exists, "
+                "another emulator uses it or it was left behind and must be removed");
+        }
+
+        throw std::runtime_error("Could not open the shared memory segment " + m_name);
+    }
+
+    if (ftruncate(fd, sizeof(SharedStateLayout)) != 0) {
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("Could not size the shared memory segment " + m_name);
+    }
+
+    void* memory = mmap(nullptr, sizeof(SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (memory == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("Could not map the shared memory segment " + m_name);
+    }
+
+    // Zeroed, a reader mapping it now sees an empty screen at frame 0
+    m_state = new (memory) SharedStateLayout();
+
+    std::memcpy(m_state->magic, "YST1", 4);
+    m_state->size = sizeof(SharedStateLayout);
+
+    m_published_generation = ~(uint64_t)0;
+}
+
+
+SharedState::~SharedState()
+{
+    if (m_state) {
+        munmap(m_state, sizeof(SharedStateLayout));
+        shm_unlink(m_name.c_str());
+    }
+}
+
+#endif
+
+
+void SharedState::publish(const Computer& computer)
+{
+    SharedStateLayout& s = *m_state;
+
+    const uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+
+    // Readers seeing an odd value, or a different one after their copy, retry
+    s.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s.frame = computer.cycle() / computer.cyclesPerFrame();
+    s.cycle = computer.cycle();
+
+    const std::array<uint8_t, 16>& registers = computer.registers();
+    std::copy(registers.begin(), registers.end(), s.registers);
+
+    s.index_register  = computer.indexRegister();
+    s.program_counter = computer.programCounter();
+
+    const std::vector<uint16_t>& stack = computer.stack();
+    const size_t n_stack_max = sizeof(s.stack) / sizeof(s.stack[0]);
+    const size_t n_stack = std::min(stack.size(), n_stack_max);
+
+    std::fill(s.stack, s.stack + n_stack_max, 0);
+    std::copy(stack.rbegin(), stack.rbegin() + n_stack, s.stack);
+    s.stack_depth = (uint16_t)std::min(stack.size(), (size_t)UINT16_MAX);
+
+    s.keys = computer.keysDown();
+
+    s.delay_timer = (uint8_t)computer.delayTimer();
+    s.sound_timer = (uint8_t)computer.soundTimer();
+
+    // About 2 KiB, only worth copying when the program drew
+    if (computer.screenGeneration() != m_published_generation) {
+        m_published_generation = computer.screenGeneration();
+
+        s.screen_generation = m_published_generation;
+        s.width       = computer.width();
+        s.height      = computer.height();
+        s.plane_count = computer.planeCount();
+
+        computer.screenBits(s.planes[0], 0);
+
+        if (s.plane_count == 2) {
+            computer.screenBits(s.planes[1], 1);
+        } else {
+            std::memset(s.planes[1], 0, sizeof(s.planes[1]));
+        }
+    }
+
+    s.sequence.store(sequence + 2, std::memory_order_release);
+}
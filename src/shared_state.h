@@ -0,0 +1,80 @@
+#pragma once
+
+#include <computer.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Machine state as laid out in the shared memory segment. Only fixed size
+// fields, in host byte order, so that other processes and languages can map
+// it as is.
+struct SharedStateLayout {
+    char magic[4]; // "YST1"
+    uint32_t size; // sizeof(SharedStateLayout)
+
+    // Odd while the emulator writes, see SharedState
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+
+    // Emulated frames and instructions since power on
+    uint64_t frame;
+    uint64_t cycle;
+
+    // Changes each time the program draws, the planes are only copied then
+    uint64_t screen_generation;
+
+    uint8_t registers[16];
+    uint16_t index_register;
+    uint16_t program_counter;
+
+    // The innermost return addresses, stack[0] being the last call
+    uint16_t stack[16];
+    uint16_t stack_depth;
+
+    // Bit N set while key N is down
+    uint16_t keys;
+
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+
+    uint8_t width;
+    uint8_t height;
+    uint8_t plane_count;
+    uint8_t padding[5];
+
+    // width / 8 bytes per row, most significant bit first
+    uint8_t planes[2][1024];
+};
+
+
+// Publishes the machine state once per emulated frame to a POSIX shared
+// memory segment, which any process on the host can map read only to watch
+// the machine without copies nor system calls.
+//
+// Writes are guarded by a sequence lock: the sequence is odd while a frame is
+// written. A reader copies what it needs between two loads of the sequence
+// and retries while they differ or are odd. The emulator never waits for the
+// readers.
+class SharedState
+{
+public:
+    // The segment is created with the given name, it must not exist yet so
+    // two emulators never write nor unlink the same one. Throws a
+    // std::runtime_error on failure or where POSIX shared memory is missing.
+    SharedState(const std::string& name);
+
+    // The segment is unlinked, readers keep their mapping
+    virtual ~SharedState();
+
+    // Emulation thread side, at the end of each frame
+    void publish(const Computer& computer);
+
+    const std::string& name() const { return m_name; }
+
+protected:
+    std::string m_name;
+    SharedStateLayout* m_state;
+
+    uint64_t m_published_generation;
+};
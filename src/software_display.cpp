@@ -0,0 +1,238 @@
+#include <software_display.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+SoftwareDisplay::SoftwareDisplay(
+    SDL_Window* window,
+    int width, int height,
+    const Palette& palette)
+    : m_window(window)
+    , m_width(width)
+    , m_height(height)
+    , m_palette(palette)
+    , m_surface(nullptr)
+    , m_surface_w(0)
+    , m_surface_h(0)
+    , m_scale(1)
+    , m_x(0)
+    , m_y(0)
+    , m_expander(palette)
+    , m_screen(width * height, 0)
+    , m_two_planes(false)
+    , m_shaded(false)
+    , m_drawn_rows(0)
+    , m_full_update(true)
+{
+    SDL_Surface* surface = SDL_GetWindowSurface(window);
+
+    if (!surface) {
+        throw std::runtime_error(SDL_GetError());
+    }
+
+    // The scaling kernels write 32 bit pixels
+    if (surface->format->BytesPerPixel != 4) {
+        throw std::runtime_error("The window surface is not 32 bits per pixel");
+    }
+
+    acquireSurface();
+}
+
+
+void SoftwareDisplay::resize(int width, int height)
+{
+    if (width == m_width && height == m_height) {
+        return;
+    }
+
+    m_width  = width;
+    m_height = height;
+
+    m_screen.assign(width * height, 0);
+
+    // Force a new layout for the new resolution
+    m_surface = nullptr;
+}
+
+
+void SoftwareDisplay::update(const uint8_t* screen, const uint8_t* second_plane, uint64_t dirty_rows)
+{
+    const int row_bytes = m_width / 8;
+    const size_t plane_size = m_height * row_bytes;
+
+    // The stored screen has to be replaced when its layout changes
+    if (m_shaded || m_two_planes != (second_plane != nullptr)) {
+        m_shaded = false;
+        m_two_planes = (second_plane != nullptr);
+        dirty_rows = ~(uint64_t)0;
+    }
+
+    forEachRowRun(dirty_rows, m_height, [&](int y_start, int y_end) {
+        std::memcpy(
+            &m_screen[y_start * row_bytes],
+            &screen[y_start * row_bytes],
+            (y_end - y_start) * row_bytes);
+
+        if (second_plane) {
+            std::memcpy(
+                &m_screen[plane_size + y_start * row_bytes],
+                &second_plane[y_start * row_bytes],
+                (y_end - y_start) * row_bytes);
+        }
+    });
+
+    drawUpdate(dirty_rows);
+}
+
+
+void SoftwareDisplay::updateShades(const uint8_t* shades, uint64_t dirty_rows)
+{
+    if (!m_shaded) {
+        m_shaded = true;
+        dirty_rows = ~(uint64_t)0;
+    }
+
+    forEachRowRun(dirty_rows, m_height, [&](int y_start, int y_end) {
+        std::memcpy(
+            &m_screen[y_start * m_width],
+            &shades[y_start * m_width],
+            (y_end - y_start) * m_width);
+    });
+
+    drawUpdate(dirty_rows);
+}
+
+
+void SoftwareDisplay::drawUpdate(uint64_t dirty_rows)
+{
+    // A new surface is entirely drawn from the screen we just copied
+    if (acquireSurface() || !m_surface) {
+        return;
+    }
+
+    forEachRowRun(dirty_rows, m_height, [&](int y_start, int y_end) {
+        drawRows(y_start, y_end);
+    });
+
+    m_drawn_rows |= dirty_rows;
+}
+
+
+void SoftwareDisplay::present()
+{
+    acquireSurface();
+
+    if (!m_surface) {
+        return;
+    }
+
+    // Nothing drawn means the window was exposed, push everything
+    if (m_full_update || m_drawn_rows == 0) {
+        SDL_UpdateWindowSurface(m_window);
+    } else {
+        m_rects.clear();
+
+        forEachRowRun(m_drawn_rows, m_height, [&](int y_start, int y_end) {
+            const SDL_Rect rect = {
+                m_x, m_y + y_start * m_scale,
+                m_width * m_scale, (y_end - y_start) * m_scale
+            };
+
+            m_rects.push_back(rect);
+        });
+
+        SDL_UpdateWindowSurfaceRects(m_window, m_rects.data(), (int)m_rects.size());
+    }
+
+    m_drawn_rows  = 0;
+    m_full_update = false;
+}
+
+
+bool SoftwareDisplay::acquireSurface()
+{
+    SDL_Surface* surface = SDL_GetWindowSurface(m_window);
+
+    if (surface == m_surface
+     && surface
+     && surface->w == m_surface_w
+     && surface->h == m_surface_h) {
+        return false;
+    }
+
+    m_surface = surface;
+
+    if (!surface) {
+        return false;
+    }
+
+    m_surface_w = surface->w;
+    m_surface_h = surface->h;
+
+    m_scale = std::max(1, std::min(m_surface_w / m_width, m_surface_h / m_height));
+    m_x = std::max(0, (m_surface_w - m_width * m_scale) / 2);
+    m_y = std::max(0, (m_surface_h - m_height * m_scale) / 2);
+
+    // Do not write past a window smaller than the screen
+    if (m_width * m_scale > m_surface_w || m_height * m_scale > m_surface_h) {
+        m_surface = nullptr;
+        return false;
+    }
+
+    const SDL_PixelFormat* format = surface->format;
+
+    Palette pixels;
+
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = SDL_MapRGB(format, (Uint8)(m_palette[i] >> 16), (Uint8)(m_palette[i] >> 8), (Uint8)m_palette[i]);
+    }
+
+    m_expander = PixelExpander(pixels);
+
+    SDL_FillRect(surface, NULL, m_expander.background());
+
+    drawRows(0, m_height);
+
+    m_full_update = true;
+
+    return true;
+}
+
+
+void SoftwareDisplay::drawRows(int y_start, int y_end)
+{
+    const int row_bytes = m_shaded ? m_width : m_width / 8;
+    const size_t plane_size = m_height * row_bytes;
+    const size_t scaled_row_size = m_width * m_scale * sizeof(uint32_t);
+
+    if (SDL_MUSTLOCK(m_surface) && SDL_LockSurface(m_surface) != 0) {
+        return;
+    }
+
+    for (int y = y_start; y < y_end; y++) {
+        uint8_t* dst = (uint8_t*)m_surface->pixels
+            + (m_y + y * m_scale) * m_surface->pitch
+            + m_x * sizeof(uint32_t);
+
+        if (m_shaded) {
+            m_expander.expandShades(&m_screen[y * row_bytes], m_width, m_scale, (uint32_t*)dst);
+        } else if (m_two_planes) {
+            m_expander.expandPlanes(
+                &m_screen[y * row_bytes], &m_screen[plane_size + y * row_bytes],
+                row_bytes, m_scale, (uint32_t*)dst);
+        } else {
+            m_expander.expandScaled(&m_screen[y * row_bytes], row_bytes, m_scale, (uint32_t*)dst);
+        }
+
+        // Replicate the scaled row
+        for (int i = 1; i < m_scale; i++) {
+            std::memcpy(dst + i * m_surface->pitch, dst, scaled_row_size);
+        }
+    }
+
+    if (SDL_MUSTLOCK(m_surface)) {
+        SDL_UnlockSurface(m_surface);
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <display.h>
+#include <pixels.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <SDL.h>
+
+// Shows the screen by writing the window surface directly, for hosts
+// without a GPU where SDL would fall back to its generic software renderer.
+//
+// The screen is scaled by the largest integer factor fitting the window,
+// each pixel and each row being replicated. The window surface keeps the
+// scaled frame: only the dirty rows are scaled again and pushed to the
+// window.
+class SoftwareDisplay: public Display
+{
+public:
+    // Colours are given as 0xRRGGBB
+    SoftwareDisplay(
+        SDL_Window* window,
+        int width, int height,
+        const Palette& palette);
+
+    void resize(int width, int height) override;
+
+    void update(const uint8_t* screen, const uint8_t* second_plane, uint64_t dirty_rows) override;
+
+    void updateShades(const uint8_t* shades, uint64_t dirty_rows) override;
+
+    void present() override;
+
+protected:
+    // Scale the rows received since the last present
+    void drawUpdate(uint64_t dirty_rows);
+
+    // Fetch the window surface, which is replaced when the window is
+    // resized. Returns true if the whole frame had to be drawn again.
+    bool acquireSurface();
+
+    // Scale the rows [y_start, y_end) of the screen to the surface
+    void drawRows(int y_start, int y_end);
+
+protected:
+    SDL_Window* m_window;
+
+    int m_width;
+    int m_height;
+
+    Palette m_palette;
+
+    SDL_Surface* m_surface;
+    int m_surface_w;
+    int m_surface_h;
+
+    // Scale factor and position of the screen in the surface
+    int m_scale;
+    int m_x;
+    int m_y;
+
+    // Colours in the format of the surface
+    PixelExpander m_expander;
+
+    // Last screen received, to draw it again on a new surface. With two
+    // planes the second follows the first, with shades it is stored as one
+    // byte per pixel.
+    std::vector<uint8_t> m_screen;
+    bool m_two_planes;
+    bool m_shaded;
+
+    // Rows drawn since the last present, all of them if m_full_update
+    uint64_t m_drawn_rows;
+    bool m_full_update;
+
+    std::vector<SDL_Rect> m_rects;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Neither push() nor pop() ever blocks.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(
+        Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+        "Capacity must be a power of two");
+
+public:
+    SpscQueue()
+        : m_head(0)
+        , m_tail(0)
+    {}
+
+    // Producer side, returns false if the queue is full
+    bool push(const T& item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side, returns false if the queue is empty
+    bool pop(T& item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire)
+            == m_tail.load(std::memory_order_acquire);
+    }
+
+protected:
+    std::array<T, Capacity> m_items;
+
+    // Head and tail live on their own cache lines to avoid false sharing
+    // between the producer and the consumer
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
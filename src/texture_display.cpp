@@ -0,0 +1,137 @@
+#include <texture_display.h>
+
+#include <stdexcept>
+
+
+TextureDisplay::TextureDisplay(
+    SDL_Window* window,
+    int width, int height,
+    const Palette& palette)
+    : m_width(width)
+    , m_height(height)
+    , m_renderer(nullptr)
+    , m_texture(nullptr)
+    , m_expander({pack_rgb(palette[0]), pack_rgb(palette[1]), pack_rgb(palette[2]), pack_rgb(palette[3])})
+{
+    // Presentation runs on its own thread, waiting for vsync does not slow
+    // down the emulation
+    m_renderer = SDL_CreateRenderer(
+        window, -1,
+        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
+    );
+
+    if (!m_renderer) {
+        throw std::runtime_error(SDL_GetError());
+    }
+
+    try {
+        createTexture();
+    } catch (...) {
+        SDL_DestroyRenderer(m_renderer);
+        throw;
+    }
+}
+
+
+TextureDisplay::~TextureDisplay()
+{
+    SDL_DestroyTexture(m_texture);
+    SDL_DestroyRenderer(m_renderer);
+}
+
+
+void TextureDisplay::resize(int width, int height)
+{
+    if (width == m_width && height == m_height) {
+        return;
+    }
+
+    SDL_DestroyTexture(m_texture);
+    m_texture = nullptr;
+
+    m_width  = width;
+    m_height = height;
+
+    createTexture();
+}
+
+
+void TextureDisplay::createTexture()
+{
+    m_texture = SDL_CreateTexture(
+        m_renderer,
+        SDL_PIXELFORMAT_RGBA32,
+        SDL_TEXTUREACCESS_STREAMING,
+        m_width, m_height
+    );
+
+    if (!m_texture) {
+        throw std::runtime_error(SDL_GetError());
+    }
+}
+
+
+void TextureDisplay::update(const uint8_t* screen, const uint8_t* second_plane, uint64_t dirty_rows)
+{
+    forEachRowRun(dirty_rows, m_height, [&](int y_start, int y_end) {
+        updateRows(screen, second_plane, y_start, y_end);
+    });
+}
+
+
+void TextureDisplay::updateShades(const uint8_t* shades, uint64_t dirty_rows)
+{
+    forEachRowRun(dirty_rows, m_height, [&](int y_start, int y_end) {
+        const SDL_Rect rows = {0, y_start, m_width, y_end - y_start};
+
+        void* pixels;
+        int pitch;
+
+        if (SDL_LockTexture(m_texture, &rows, &pixels, &pitch) != 0) {
+            return;
+        }
+
+        for (int y = y_start; y < y_end; y++) {
+            m_expander.expandShades(
+                &shades[y * m_width], m_width, 1,
+                (uint32_t*)((uint8_t*)pixels + (y - y_start) * pitch)
+            );
+        }
+
+        SDL_UnlockTexture(m_texture);
+    });
+}
+
+
+void TextureDisplay::present()
+{
+    SDL_RenderCopy(m_renderer, m_texture, NULL, NULL);
+    SDL_RenderPresent(m_renderer);
+}
+
+
+void TextureDisplay::updateRows(const uint8_t* screen, const uint8_t* second_plane, int y_start, int y_end)
+{
+    const int row_bytes = m_width / 8;
+    const SDL_Rect rows = {0, y_start, m_width, y_end - y_start};
+
+    void* pixels;
+    int pitch;
+
+    if (SDL_LockTexture(m_texture, &rows, &pixels, &pitch) != 0) {
+        return;
+    }
+
+    // The locked memory is write-only and its rows may be padded
+    for (int y = y_start; y < y_end; y++) {
+        uint32_t* row = (uint32_t*)((uint8_t*)pixels + (y - y_start) * pitch);
+
+        if (second_plane) {
+            m_expander.expandPlanes(&screen[y * row_bytes], &second_plane[y * row_bytes], row_bytes, 1, row);
+        } else {
+            m_expander.expand(&screen[y * row_bytes], row_bytes, row);
+        }
+    }
+
+    SDL_UnlockTexture(m_texture);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <display.h>
+#include <pixels.h>
+
+#include <cstdint>
+
+#include <SDL.h>
+
+// Shows the screen through a SDL renderer, scaled by the GPU if available.
+//
+// The texture is a streaming one: only the dirty rows are locked and written,
+// there is no intermediate copy of the whole frame.
+class TextureDisplay: public Display
+{
+public:
+    // Colours are given as 0xRRGGBB
+    TextureDisplay(
+        SDL_Window* window,
+        int width, int height,
+        const Palette& palette);
+
+    virtual ~TextureDisplay();
+
+    void resize(int width, int height) override;
+
+    void update(const uint8_t* screen, const uint8_t* second_plane, uint64_t dirty_rows) override;
+
+    void updateShades(const uint8_t* shades, uint64_t dirty_rows) override;
+
+    // Draw the texture to the whole window and wait for vsync
+    void present() override;
+
+protected:
+    // Create the texture for the current resolution
+    void createTexture();
+
+    void updateRows(const uint8_t* screen, const uint8_t* second_plane, int y_start, int y_end);
+
+protected:
+    int m_width;
+    int m_height;
+
+    SDL_Renderer* m_renderer;
+    SDL_Texture*  m_texture;
+
+    const PixelExpander m_expander;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer to hand over values from one producer thread to one
+// consumer thread.
+//
+// The producer fills back() then publish() it. The consumer calls update() to
+// get the most recently published value in front(). Neither side ever waits
+// for the other: values published faster than they are consumed are
+// overwritten.
+template<typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+        : m_middle(1)
+        , m_back(0)
+        , m_front(2)
+    {}
+
+    // Producer side
+    T& back() { return m_buffers[m_back]; }
+
+    void publish()
+    {
+        const uint8_t previous = m_middle.exchange(m_back | fresh_bit, std::memory_order_acq_rel);
+        m_back = previous & index_mask;
+    }
+
+    // Consumer side, returns true if a new value is available in front()
+    bool update()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & fresh_bit) == 0) {
+            return false;
+        }
+
+        const uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & index_mask;
+
+        return true;
+    }
+
+    const T& front() const { return m_buffers[m_front]; }
+
+protected:
+    static constexpr uint8_t index_mask = 0x3;
+    static constexpr uint8_t fresh_bit  = 0x4;
+
+    std::array<T, 3> m_buffers;
+
+    // Index of the buffer shared between the two sides, with a flag telling
+    // if it was published since the consumer last took it
+    std::atomic<uint8_t> m_middle;
+
+    uint8_t m_back;
+    uint8_t m_front;
+};